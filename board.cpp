@@ -1,19 +1,20 @@
 #include "board.h"
 
+#ifdef USE_PEXT
+#include <immintrin.h>
+#endif
+
 // the board constructor, which parses a FEN-string:
-board::board(char* FEN) : base_score_opening(0), base_score_endgame(0), game_phase_score(0),
+board::board(char* FEN) : base_score(0), game_phase_score(0),
   ply(0), castle_rights(0), CANT_CAPTURE(0L), CAN_CAPTURE(0L), fifty_move_counter(0),
-  EMPTY_SQUARES(0L), CAN_MOVE_TO(0L), OCCUPIED_SQUARES(0L), hash(0L) {
+  EMPTY_SQUARES(0L), CAN_MOVE_TO(0L), OCCUPIED_SQUARES(0L), hash(0L), pawn_hash(0L),
+  material_key(0L) {
   // clear the bitboards:
   memset(bitboard, 0, 12 * sizeof(U64));
 
   // clear the piece board:
   // NOTE: the piece board is used for quick piece-square lookup
-  memset(piece_board, NONE, 64 * sizeof(int));
-
-  // clear the move and repetition history list:
-  memset(move_history, 0, MAX_GAME_MOVES * sizeof(int));
-  memset(repetition_history, 0, MAX_GAME_MOVES * sizeof(U64));
+  memset(piece_board, NONE, 64 * sizeof(char));
 
   // parse the main FEN. (i is the shift index)
   int i = 0;
@@ -24,10 +25,11 @@ board::board(char* FEN) : base_score_opening(0), base_score_endgame(0), game_pha
       piece_type = PIECE_INDICES.find(*FEN)->second;
       bitboard[piece_type] |= (1L << i);
       piece_board[i] = piece_type;
-      base_score_opening += PIECE_SQUARE_TABLE[OPENING_PHASE][piece_type][i];
-      base_score_endgame += PIECE_SQUARE_TABLE[ENDGAME_PHASE][piece_type][i];
+      base_score += PIECE_SQUARE_SCORE[piece_type][i];
       game_phase_score += GAME_PHASE_MATERIAL_SCORE[piece_type];
+      material_key += MATERIAL_KEY(piece_type);
       hash ^= ZOBRIST_SQUARE_KEYS[piece_type][i];
+      if (piece_type == WP || piece_type == BP) pawn_hash ^= ZOBRIST_SQUARE_KEYS[piece_type][i];
     }
     else i--; // to handle '/' (we -1 to cancel out the i++)
 
@@ -100,103 +102,222 @@ board::board(char* FEN) : base_score_opening(0), base_score_endgame(0), game_pha
  * 0000 0000 0000 0000 0000 0000 0000 1111 -> piece moved, i.e., a white knight (4 bits)
 */
 int board::get_moves(int* move_list) {
-  int num_moves = 0;
+  PROFILE(PROFILE_GET_MOVES);
 
   // update move generation bitboards:
   update_move_info_bitboards();
 
-  add_pawn_moves(move_list, num_moves);
-  add_diag_moves(move_list, num_moves);
-  add_line_moves(move_list, num_moves);
-  add_knight_moves(move_list, num_moves);
-  add_king_moves(move_list, num_moves);
-
-  // now we have all pseudo-legal moves. let's eliminate illegal moves!
-  // we only need to check moves in four conditions: en passant, pinned piece is
-  // moved, when we're in check, and when the king moves.
-  bool valid[num_moves];
-  int num_invalid = 0;
-  bool check = is_check();
-  U64 pinned = pinned_pieces();
-  for (int i = 0; i < num_moves; i++) {
-    // determine if a move is valid:
-    valid[i] = true;
-
-    // we only need to actually check a move in these conditions:
-    if (check || MOVE_PIECEMOVED(move_list[i]) - turn == KING ||
-       (pinned & (1L << MOVE_FROM(move_list[i]))) || MOVE_IS_EP(move_list[i])) {
-         valid[i] = make_move(move_list[i]);
-         undo_move();
-    }
-  }
+  int num_moves = get_captures(move_list);
+  num_moves += get_quiets(move_list + num_moves);
 
-  // now we push invalid moves to the end of the move stack, then shorten its
-  // length (essentially removing them):
-  int j = 0; // always <= i
-  for (int i = 0; i < num_moves; i++) {
-    if (valid[i] && !valid[j]) {
-      std::swap(move_list[i], move_list[j]);
-      std::swap(valid[i], valid[j]);
-    }
-    if (valid[j]) j++;
+  return num_moves;
+}
+
+// get_nonquiet_moves(): generates all legal captures and promotions:
+int board::get_nonquiet_moves(int* move_list) {
+  // update move generation bitboards:
+  update_move_info_bitboards();
+
+  return get_captures(move_list);
+}
+
+/* get_captures() and get_quiets(): the two halves of get_moves() for the staged
+ * move picker. together they generate every legal move exactly once:
+ * get_captures() generates captures and promotions, and get_quiets() generates
+ * everything else. the move info bitboards are assumed to be up to date.
+ *
+ * the generators only produce legal moves: the king never steps onto an UNSAFE
+ * square, pinned pieces only move along their pin, and in check, all other
+ * pieces have to capture the checker or block the check (CHECK_MASK). in double
+ * check, only the king can move. pinned pawns and en passant captures are the
+ * only moves that are checked one by one, with is_legal().
+*/
+int board::get_captures(int* move_list) {
+  PROFILE(PROFILE_GET_CAPTURES);
+
+  int num_moves = 0;
+
+  if (!SEVERAL(CHECKERS)) {
+    add_nonquiet_pawn_moves(move_list, num_moves);
+    add_nonquiet_diag_moves(move_list, num_moves);
+    add_nonquiet_line_moves(move_list, num_moves);
+    add_nonquiet_knight_moves(move_list, num_moves);
   }
+  add_nonquiet_king_moves(move_list, num_moves);
 
-  // update the number of moves to eliminate invalid moves.
-  // j here always = human index of the first invalid move, which is the
-  // number of valid moves:
-  num_moves = j;
+  // filter out illegal pawn moves (only possible with a pinned pawn, or if we
+  // generated an en passant capture):
+  if ((PINNED & bitboard[PAWN + turn]) || (ply && MOVE_IS_PAWNFIRST(history[ply-1].move))) {
+    num_moves = remove_illegal_moves(move_list, num_moves);
+  }
 
   return num_moves;
 }
 
-int board::get_nonquiet_moves(int* move_list) {
+int board::get_quiets(int* move_list) {
+  PROFILE(PROFILE_GET_QUIETS);
+
   int num_moves = 0;
 
-  // update move generation bitboards:
-  update_move_info_bitboards();
+  if (!SEVERAL(CHECKERS)) {
+    add_quiet_pawn_moves(move_list, num_moves);
+    add_quiet_diag_moves(move_list, num_moves);
+    add_quiet_line_moves(move_list, num_moves);
+    add_quiet_knight_moves(move_list, num_moves);
+  }
+  add_quiet_king_moves(move_list, num_moves);
 
-  add_nonquiet_pawn_moves(move_list, num_moves);
-  add_nonquiet_diag_moves(move_list, num_moves);
-  add_nonquiet_line_moves(move_list, num_moves);
-  add_nonquiet_knight_moves(move_list, num_moves);
-  add_nonquiet_king_moves(move_list, num_moves);
+  // filter out illegal pawn pushes (only possible with a pinned pawn):
+  if (PINNED & bitboard[PAWN + turn]) num_moves = remove_illegal_moves(move_list, num_moves);
+
+  return num_moves;
+}
 
-  // now we have all pseudo-legal moves. let's eliminate illegal moves!
-  // we only need to check moves in four conditions: en passant, pinned piece is
-  // moved, when we're in check, and when the king moves.
-  bool valid[num_moves];
-  int num_invalid = 0;
-  bool check = is_check();
-  U64 pinned = pinned_pieces();
+// remove_illegal_moves(): removes the illegal moves from the given move list
+// (keeping the order of the rest), and returns the new number of moves:
+int board::remove_illegal_moves(int* move_list, int num_moves) {
+  int j = 0;
   for (int i = 0; i < num_moves; i++) {
-    // determine if a move is valid:
-    valid[i] = true;
-
-    // we only need to actually check a move in these conditions:
-    if (check || MOVE_PIECEMOVED(move_list[i]) - turn == KING ||
-       (pinned & (1L << MOVE_FROM(move_list[i]))) || MOVE_IS_EP(move_list[i])) {
-         valid[i] = make_move(move_list[i]);
-         undo_move();
-    }
+    if (is_legal(move_list[i])) move_list[j++] = move_list[i];
   }
+  return j;
+}
 
-  // now we push invalid moves to the end of the move stack, then shorten its
-  // length (essentially removing them):
-  int j = 0; // always <= i
-  for (int i = 0; i < num_moves; i++) {
-    if (valid[i] && !valid[j]) {
-      std::swap(move_list[i], move_list[j]);
-      std::swap(valid[i], valid[j]);
+/* is_legal(): is the given pseudo-legal move legal? this only needs the checker
+ * and pin masks, and never makes the move. assumes the move info bitboards are
+ * up to date.
+*/
+bool board::is_legal(int move) {
+  int from = MOVE_FROM(move);
+  int to = MOVE_TO(move);
+  char king_square = LSB(bitboard[KING + turn]);
+
+  // the king can't move to an attacked square. (castling moves are only
+  // generated when the king and the squares it crosses are safe):
+  if (from == king_square) return MOVE_IS_CASTLE(move) || !(UNSAFE & (1L << to));
+
+  // in double check, only the king can move:
+  if (SEVERAL(CHECKERS)) return false;
+
+  // en passant removes two pieces from the capturing pawn's rank, so it can
+  // expose the king in ways a pin can't describe. we simply look for
+  // attackers after the capture:
+  if (MOVE_IS_EP(move)) {
+    int captured_square = (from & ~7) | (to & 7);
+    U64 occupied = (OCCUPIED_SQUARES ^ (1L << from) ^ (1L << captured_square)) | (1L << to);
+    return !(get_attackers(occupied, king_square) & CAN_CAPTURE & occupied);
+  }
+
+  // in check, we have to capture the checker or block the check:
+  if (!(CHECK_MASK & (1L << to))) return false;
+
+  // a pinned piece can only move along the line through it and the king:
+  return !(PINNED & (1L << from)) || (LINE_LOOKUP[king_square][from] & (1L << to));
+}
+
+/* move_from_short(): returns the full move matching the given short move (see
+ * MOVE_SHORT) if it's legal in this position, or NULL if it isn't. this lets
+ * the search try the TT move and the killer moves without generating any
+ * moves. the result is identical to the move int get_moves() would generate.
+ * assumes the move info bitboards are up to date.
+*/
+int board::move_from_short(int short_move) {
+  int move = pseudo_legal_move_from_short(short_move);
+  return (move && is_legal(move)) ? move : NULL;
+}
+
+// pseudo_legal_move_from_short(): same as move_from_short(), but only checks
+// that the move is pseudo-legal:
+int board::pseudo_legal_move_from_short(int short_move) {
+  int from = short_move & 0x3F;
+  int to = (short_move >> 6) & 0x3F;
+  int promotion_type = (short_move >> 12) & 0x7;
+  int piece_moved = piece_board[from];
+  int captured = piece_board[to];
+  U64 to_bb = 1L << to;
+
+  // we have to move one of our own pieces to a square without one:
+  if (piece_moved == NONE || !(CANT_CAPTURE & (1L << from)) || !(CAN_MOVE_TO & to_bb)) return NULL;
+
+  // pawns are the only pieces with special rules:
+  if (piece_moved - turn == PAWN) {
+    int forward = (turn == WHITE) ? -8 : 8;
+    bool last_rank = to_bb & (RANKS[1] | RANKS[8]);
+    bool diagonal = (to == from + forward - 1 || to == from + forward + 1) &&
+                    (KING_MOVES[from] & to_bb);
+
+    // a pawn promotes if and only if it reaches the last rank:
+    if (last_rank != (promotion_type != PAWN)) return NULL;
+    if (promotion_type > QUEEN) return NULL;
+    int promotion_piece = last_rank ? turn + promotion_type : NONE;
+
+    // single push (or promotion by push):
+    if (to == from + forward) {
+      if (captured != NONE) return NULL;
+      return move_int(to, from, NONE, 0, 0, 0, last_rank, promotion_piece, castle_rights, piece_moved);
+    }
+
+    // double push from the pawn's starting rank:
+    if (to == from + 2 * forward) {
+      U64 start_rank = (turn == WHITE) ? RANKS[2] : RANKS[7];
+      if (!((1L << from) & start_rank) || captured != NONE || piece_board[from + forward] != NONE) return NULL;
+      return move_int(to, from, NONE, 0, 1, 0, 0, NONE, castle_rights, piece_moved);
+    }
+
+    if (!diagonal) return NULL;
+
+    // capture (or promotion by capture):
+    if (captured != NONE) {
+      return move_int(to, from, captured, 0, 0, 0, last_rank, promotion_piece, castle_rights, piece_moved);
+    }
+
+    // en passant: the last move was a double push to the square behind TO:
+    if (ply && MOVE_IS_PAWNFIRST(history[ply-1].move) && MOVE_TO(history[ply-1].move) == to - forward) {
+      int captured_pawn = (turn == WHITE) ? BP : WP;
+      return move_int(to, from, captured_pawn, 1, 0, 0, 0, NONE, castle_rights, piece_moved);
     }
-    if (valid[j]) j++;
+
+    return NULL;
   }
 
-  // update the number of moves to eliminate invalid moves.
-  // j here always = human index of the first invalid move, which is the
-  // number of valid moves:
-  num_moves = j;
+  // only pawns promote:
+  if (promotion_type != PAWN) return NULL;
 
-  return num_moves;
+  U64 attacks = 0L;
+  switch (piece_moved - turn) {
+    case KNIGHT:
+      attacks = KNIGHT_MOVES[from];
+      break;
+    case BISHOP:
+      attacks = diag_moves_magic(from, OCCUPIED_SQUARES);
+      break;
+    case ROOK:
+      attacks = line_moves_magic(from, OCCUPIED_SQUARES);
+      break;
+    case QUEEN:
+      attacks = diag_moves_magic(from, OCCUPIED_SQUARES) | line_moves_magic(from, OCCUPIED_SQUARES);
+      break;
+    case KING:
+      attacks = KING_MOVES[from];
+
+      // castling (with the same conditions as add_quiet_king_moves()):
+      if (!(attacks & to_bb) && !(UNSAFE & bitboard[piece_moved])) {
+        bool can_castle = false;
+        if (turn == WHITE && from == E1) {
+          can_castle = (to == G1 && CAN_CWK(castle_rights) && !((OCCUPIED_SQUARES | UNSAFE) & CWK_SAFE_SPACES)) ||
+                       (to == C1 && CAN_CWQ(castle_rights) && !((UNSAFE & CWQ_SAFE_SPACES) || (OCCUPIED_SQUARES & CWQ_EMPTY_SPACES)));
+        }
+        else if (turn == BLACK && from == E8) {
+          can_castle = (to == G8 && CAN_CBK(castle_rights) && !((OCCUPIED_SQUARES | UNSAFE) & CBK_SAFE_SPACES)) ||
+                       (to == C8 && CAN_CBQ(castle_rights) && !((UNSAFE & CBQ_SAFE_SPACES) || (OCCUPIED_SQUARES & CBQ_EMPTY_SPACES)));
+        }
+        if (can_castle) return move_int(to, from, NONE, 0, 0, 1, 0, NONE, castle_rights, piece_moved);
+      }
+      break;
+  }
+
+  if (!(attacks & to_bb)) return NULL;
+  return move_int(to, from, captured, castle_rights, piece_moved);
 }
 
 // make_move(char* move): converts the given human-formatted (i.e., e4e5) move
@@ -248,16 +369,25 @@ bool board::make_move(char* move) {
 
   if (!found) return false;
 
-  return make_move(m);
+  make_move(m);
+  return true;
 }
 
-// make_move(): makes the given (presumably pseudo-legal) move and checks if
-// it's legal. returns true if legal, false otherwise.
-bool board::make_move(int move) {
-  // first of all, let's push the move to our move_history stack:
-  repetition_history[ply] = hash;
-  fifty_move_history[ply] = fifty_move_counter;
-  move_history[ply++] = move;
+// make_move(): makes the given legal move:
+void board::make_move(int move) {
+  PROFILE(PROFILE_MAKE_MOVE);
+
+  // first of all, let's push the move and the state it overwrites to our
+  // history stack:
+  if (ply == (int) history.size()) history.emplace_back();
+  undo_info& u = history[ply++];
+  u.move = move;
+  u.hash = hash;
+  u.pawn_hash = pawn_hash;
+  u.material_key = material_key;
+  u.base_score = base_score;
+  u.game_phase_score = game_phase_score;
+  u.fifty_move_counter = fifty_move_counter;
 
   // get move info:
   int to = MOVE_TO(move);
@@ -272,19 +402,28 @@ bool board::make_move(int move) {
   if (captured == NONE && piece_moved != WP && piece_moved != BP) fifty_move_counter++;
   else fifty_move_counter = 0;
 
+  // update the pawn hash (a promoting pawn doesn't arrive as a pawn, and an en
+  // passant capture takes a pawn from beside its TO-square):
+  if (piece_moved == WP || piece_moved == BP) {
+    pawn_hash ^= ZOBRIST_SQUARE_KEYS[piece_moved][from];
+    if (!promotion) pawn_hash ^= ZOBRIST_SQUARE_KEYS[piece_moved][to];
+  }
+  if (captured == WP || captured == BP) {
+    int captured_square = ep ? (from & ~7) | (to & 7) : to;
+    pawn_hash ^= ZOBRIST_SQUARE_KEYS[captured][captured_square];
+  }
+
   // move the piece to its new board location:
   bitboard[piece_moved] |= (1L << to);
   piece_board[to] = piece_moved;
   hash ^= ZOBRIST_SQUARE_KEYS[piece_moved][to];
-  base_score_opening += PIECE_SQUARE_TABLE[OPENING_PHASE][piece_moved][to];
-  base_score_endgame += PIECE_SQUARE_TABLE[ENDGAME_PHASE][piece_moved][to];
+  base_score += PIECE_SQUARE_SCORE[piece_moved][to];
 
   // remove the piece from its old location:
   bitboard[piece_moved] ^= (1L << from);
   piece_board[from] = NONE;
   hash ^= ZOBRIST_SQUARE_KEYS[piece_moved][from];
-  base_score_opening -= PIECE_SQUARE_TABLE[OPENING_PHASE][piece_moved][from];
-  base_score_endgame -= PIECE_SQUARE_TABLE[ENDGAME_PHASE][piece_moved][from];
+  base_score -= PIECE_SQUARE_SCORE[piece_moved][from];
 
   // update W and B bitboards:
   if (turn == WHITE) W ^= (1L << to) | (1L << from);
@@ -323,9 +462,9 @@ bool board::make_move(int move) {
     bitboard[captured] ^= (1L << to);
     hash ^= ZOBRIST_SQUARE_KEYS[captured][to];
 
-    base_score_opening -= PIECE_SQUARE_TABLE[OPENING_PHASE][captured][to];
-    base_score_endgame -= PIECE_SQUARE_TABLE[ENDGAME_PHASE][captured][to];
+    base_score -= PIECE_SQUARE_SCORE[captured][to];
     game_phase_score -= GAME_PHASE_MATERIAL_SCORE[captured];
+    material_key -= MATERIAL_KEY(captured);
 
     // update the W or B bitboard:
     if (turn == WHITE) B ^= (1L << to);
@@ -338,8 +477,7 @@ bool board::make_move(int move) {
     // incorrect zobrist hashing and base_score scoring:
     bitboard[captured] ^= (1L << to);
     hash ^= ZOBRIST_SQUARE_KEYS[captured][to];
-    base_score_opening += PIECE_SQUARE_TABLE[OPENING_PHASE][captured][to];
-    base_score_endgame += PIECE_SQUARE_TABLE[ENDGAME_PHASE][captured][to];
+    base_score += PIECE_SQUARE_SCORE[captured][to];
 
     // we have to flip it again in the W or B bitboard as well:
     if (turn == WHITE) B ^= (1L << to);
@@ -355,8 +493,7 @@ bool board::make_move(int move) {
 
         // hash out the captured pawn and update base score:
         hash ^= ZOBRIST_SQUARE_KEYS[BP][from+1];
-        base_score_opening -= PIECE_SQUARE_TABLE[OPENING_PHASE][BP][from+1];
-        base_score_endgame -= PIECE_SQUARE_TABLE[ENDGAME_PHASE][BP][from+1];
+        base_score -= PIECE_SQUARE_SCORE[BP][from+1];
         break;
       case 9:
         // white en passant captures left
@@ -366,8 +503,7 @@ bool board::make_move(int move) {
 
         // hash out the captured pawn and update base score:
         hash ^= ZOBRIST_SQUARE_KEYS[BP][from-1];
-        base_score_opening -= PIECE_SQUARE_TABLE[OPENING_PHASE][BP][from-1];
-        base_score_endgame -= PIECE_SQUARE_TABLE[ENDGAME_PHASE][BP][from-1];
+        base_score -= PIECE_SQUARE_SCORE[BP][from-1];
         break;
       case -9:
         // black en passant captures right
@@ -377,8 +513,7 @@ bool board::make_move(int move) {
 
         // hash out the captured pawn and update base score:
         hash ^= ZOBRIST_SQUARE_KEYS[WP][from+1];
-        base_score_opening -= PIECE_SQUARE_TABLE[OPENING_PHASE][WP][from+1];
-        base_score_endgame -= PIECE_SQUARE_TABLE[ENDGAME_PHASE][WP][from+1];
+        base_score -= PIECE_SQUARE_SCORE[WP][from+1];
         break;
       case -7:
         // black en passant captures left
@@ -388,8 +523,7 @@ bool board::make_move(int move) {
 
         // hash out the captured pawn and update base score:
         hash ^= ZOBRIST_SQUARE_KEYS[WP][from-1];
-        base_score_opening -= PIECE_SQUARE_TABLE[OPENING_PHASE][WP][from-1];
-        base_score_endgame -= PIECE_SQUARE_TABLE[ENDGAME_PHASE][WP][from-1];
+        base_score -= PIECE_SQUARE_SCORE[WP][from-1];
         break;
     }
   }
@@ -406,8 +540,7 @@ bool board::make_move(int move) {
         castle_rights &= 0x3; // cancel out castle rights
 
         // update hash and base_score:
-        base_score_opening += CWK_ROOK_PST_DIFFERENCE_OPENING;
-        base_score_endgame += CWK_ROOK_PST_DIFFERENCE_ENDGAME;
+        base_score += CWK_ROOK_PST_DIFFERENCE;
         hash ^= CWK_ROOK_ZOBRIST;
         break;
       case C1:
@@ -419,8 +552,7 @@ bool board::make_move(int move) {
         castle_rights &= 0x3; // cancel out castle rights
 
         // update hash and base_score:
-        base_score_opening += CWQ_ROOK_PST_DIFFERENCE_OPENING;
-        base_score_endgame += CWQ_ROOK_PST_DIFFERENCE_ENDGAME;
+        base_score += CWQ_ROOK_PST_DIFFERENCE;
         hash ^= CWQ_ROOK_ZOBRIST;
         break;
       case G8:
@@ -432,8 +564,7 @@ bool board::make_move(int move) {
         castle_rights &= 0xC; // cancel out castle rights
 
         // update hash and base_score:
-        base_score_opening += CBK_ROOK_PST_DIFFERENCE_OPENING;
-        base_score_endgame += CBK_ROOK_PST_DIFFERENCE_ENDGAME;
+        base_score += CBK_ROOK_PST_DIFFERENCE;
         hash ^= CBK_ROOK_ZOBRIST;
         break;
       case C8:
@@ -445,8 +576,7 @@ bool board::make_move(int move) {
         castle_rights &= 0xC; // cancel out castle rights
 
         // update hash and base_score:
-        base_score_opening += CBQ_ROOK_PST_DIFFERENCE_OPENING;
-        base_score_endgame += CBQ_ROOK_PST_DIFFERENCE_ENDGAME;
+        base_score += CBQ_ROOK_PST_DIFFERENCE;
         hash ^= CBQ_ROOK_ZOBRIST;
         break;
     }
@@ -466,12 +596,11 @@ bool board::make_move(int move) {
     hash ^= ZOBRIST_SQUARE_KEYS[promoted_piece][to];
 
     // update base_score:
-    base_score_opening += PIECE_SQUARE_TABLE[OPENING_PHASE][promoted_piece][to] - // new promotion piece
-                  PIECE_SQUARE_TABLE[OPENING_PHASE][piece_moved][to]; // remove pawn from promotion square
-    base_score_endgame += PIECE_SQUARE_TABLE[ENDGAME_PHASE][promoted_piece][to] - // new promotion piece
-                  PIECE_SQUARE_TABLE[ENDGAME_PHASE][piece_moved][to]; // remove pawn from promotion square
+    base_score += PIECE_SQUARE_SCORE[promoted_piece][to] - // new promotion piece
+                  PIECE_SQUARE_SCORE[piece_moved][to]; // remove pawn from promotion square
 
     game_phase_score += GAME_PHASE_MATERIAL_SCORE[promoted_piece];
+    material_key += MATERIAL_KEY(promoted_piece) - MATERIAL_KEY(piece_moved);
   }
 
   // hash in new castle rights (if they were changed);
@@ -480,26 +609,68 @@ bool board::make_move(int move) {
     hash ^= ZOBRIST_CASTLE_RIGHTS_KEYS[castle_rights];
   }
 
-  // update the move info bitboards (while avoiding redundancies):
-  update_move_info_bitboards();
-
   // flip the turn:
   turn = (turn == WHITE) ? BLACK : WHITE;
   hash ^= ZOBRIST_TURN_KEY;
 
-  // now comes the moment of truth. is this move legal? well, only if we're not in check:
-  return !(UNSAFE & bitboard[KING + ((turn == WHITE) ? BLACK : WHITE)]);
+  // update the network's accumulator (if we have a network):
+  if (nnue_network) nnue_update(*this, move, piece_moved);
+}
+
+// key_after(): the zobrist hash of the position after the given move, computed
+// without making it (so the search can prefetch the child's TT bucket early):
+U64 board::key_after(int move) {
+  int to = MOVE_TO(move);
+  int from = MOVE_FROM(move);
+  int captured = MOVE_CAPTURED(move);
+  int piece_moved = piece_board[from];
+
+  // flip the turn and move the piece (or the piece it promotes to):
+  U64 key = hash ^ ZOBRIST_TURN_KEY ^ ZOBRIST_SQUARE_KEYS[piece_moved][from];
+  if (MOVE_IS_PROMOTION(move)) key ^= ZOBRIST_SQUARE_KEYS[MOVE_PROMOTION_PIECE(move)][to];
+  else key ^= ZOBRIST_SQUARE_KEYS[piece_moved][to];
+
+  // hash out the captured piece (an en passant captures on FROM's rank):
+  if (captured != NONE) {
+    int captured_square = MOVE_IS_EP(move) ? (from & ~7) | (to & 7) : to;
+    key ^= ZOBRIST_SQUARE_KEYS[captured][captured_square];
+  }
+
+  // move the rook if this is a castle:
+  if (MOVE_IS_CASTLE(move)) {
+    switch (to) {
+      case G1: key ^= CWK_ROOK_ZOBRIST; break;
+      case C1: key ^= CWQ_ROOK_ZOBRIST; break;
+      case G8: key ^= CBK_ROOK_ZOBRIST; break;
+      case C8: key ^= CBQ_ROOK_ZOBRIST; break;
+    }
+  }
+
+  // hash in new castle rights (if they changed):
+  char new_castle_rights = castle_rights & CASTLE_RIGHTS_MASK[from] & CASTLE_RIGHTS_MASK[to];
+  if (new_castle_rights != castle_rights) {
+    key ^= ZOBRIST_CASTLE_RIGHTS_KEYS[castle_rights];
+    key ^= ZOBRIST_CASTLE_RIGHTS_KEYS[new_castle_rights];
+  }
+
+  return key;
 }
 
-// undo_move(): undoes the last move made
+// undo_move(): undoes the last move made. the hashes, scores and fifty move
+// counter are restored from the history stack; only the pieces are moved back:
 void board::undo_move() {
-  // first of all, let's pop the move off our move_history stack:
-  ply--;
+  PROFILE(PROFILE_UNDO_MOVE);
 
-  // update fifty_move_counter:
-  fifty_move_counter = fifty_move_history[ply];
+  // first of all, let's pop the move off our history stack:
+  const undo_info& u = history[--ply];
+  hash = u.hash;
+  pawn_hash = u.pawn_hash;
+  material_key = u.material_key;
+  base_score = u.base_score;
+  game_phase_score = u.game_phase_score;
+  fifty_move_counter = u.fifty_move_counter;
 
-  int move = move_history[ply];
+  int move = u.move;
 
   // get move info:
   int to = MOVE_TO(move);
@@ -509,110 +680,40 @@ void board::undo_move() {
   int ep = MOVE_IS_EP(move);
   int castle = MOVE_IS_CASTLE(move);
   int promotion = MOVE_IS_PROMOTION(move);
-  int pcr = MOVE_PCR(move);
 
   // remove the piece back from its current board location:
   bitboard[piece_moved] ^= (1L << to);
   piece_board[to] = NONE;
-  hash ^= ZOBRIST_SQUARE_KEYS[piece_moved][to];
-  base_score_opening -= PIECE_SQUARE_TABLE[OPENING_PHASE][piece_moved][to];
-  base_score_endgame -= PIECE_SQUARE_TABLE[ENDGAME_PHASE][piece_moved][to];
 
   // put the piece back in its previous location:
   bitboard[piece_moved] |= (1L << from);
   piece_board[from] = piece_moved;
-  hash ^= ZOBRIST_SQUARE_KEYS[piece_moved][from];
-  base_score_opening += PIECE_SQUARE_TABLE[OPENING_PHASE][piece_moved][from];
-  base_score_endgame += PIECE_SQUARE_TABLE[ENDGAME_PHASE][piece_moved][from];
 
   // update W or B bitboards:
   if (turn == WHITE) B ^= (1L << to) | (1L << from);
   else W ^= (1L << to) | (1L << from);
 
   // reload castle rights:
-  if (castle_rights != pcr) {
-    hash ^= ZOBRIST_CASTLE_RIGHTS_KEYS[castle_rights];
-    hash ^= ZOBRIST_CASTLE_RIGHTS_KEYS[pcr];
-    castle_rights = pcr;
-  }
+  castle_rights = MOVE_PCR(move);
 
-  // if a piece was captured, update the board and base_score:
+  // if a piece was captured, put it back:
   if (captured != NONE) {
-    bitboard[captured] |= (1L << to);
-    piece_board[to] = captured;
-    hash ^= ZOBRIST_SQUARE_KEYS[captured][to];
-
-    base_score_opening += PIECE_SQUARE_TABLE[OPENING_PHASE][captured][to];
-    base_score_endgame += PIECE_SQUARE_TABLE[ENDGAME_PHASE][captured][to];
-    game_phase_score += GAME_PHASE_MATERIAL_SCORE[captured];
-
-    if (turn == WHITE) W ^= (1L << to);
-    else B ^= (1L << to);
-  }
-
-  // if this was an en passant, put the pawn back on the board:
-  if (ep) {
-    // then we flipped the wrong bit in the 'captured' section and need to flip
-    // it again, as well as undo the incorrect zobrist hashing and base_score scoring:
-    bitboard[captured] ^= (1L << to);
-    hash ^= ZOBRIST_SQUARE_KEYS[captured][to];
-    base_score_opening -= PIECE_SQUARE_TABLE[OPENING_PHASE][captured][to];
-    base_score_endgame -= PIECE_SQUARE_TABLE[ENDGAME_PHASE][captured][to];
-
-    // we have to flip it in the W or B bitboard as well:
-    if (turn == WHITE) W ^= (1L << to);
-    else B ^= (1L << to);
-
-    // in which direction was the capture?
-    switch (from - to) {
-      case 7:
-        // white en passant captures right
-        bitboard[BP] ^= (1L << (from + 1));
-        B ^= (1L << (from + 1));
-        piece_board[from - 7] = NONE;
-        piece_board[from + 1] = BP;
-
-        // hash in the captured pawn and update base score:
-        hash ^= ZOBRIST_SQUARE_KEYS[BP][from+1];
-        base_score_opening += PIECE_SQUARE_TABLE[OPENING_PHASE][BP][from+1];
-        base_score_endgame += PIECE_SQUARE_TABLE[ENDGAME_PHASE][BP][from+1];
-        break;
-      case 9:
-        // white en passant captures left
-        bitboard[BP] ^= (1L << (from - 1));
-        B ^= (1L << (from - 1));
-        piece_board[from - 9] = NONE;
-        piece_board[from - 1] = BP;
-
-        // hash in the captured pawn and update base score:
-        hash ^= ZOBRIST_SQUARE_KEYS[BP][from-1];
-        base_score_opening += PIECE_SQUARE_TABLE[OPENING_PHASE][BP][from-1];
-        base_score_endgame += PIECE_SQUARE_TABLE[ENDGAME_PHASE][BP][from-1];
-        break;
-      case -9:
-        // black en passant captures right
-        bitboard[WP] ^= (1L << (from + 1));
-        W ^= (1L << (from + 1));
-        piece_board[from + 9] = NONE;
-        piece_board[from + 1] = WP;
-
-        // hash in the captured pawn and update base score:
-        hash ^= ZOBRIST_SQUARE_KEYS[WP][from+1];
-        base_score_opening += PIECE_SQUARE_TABLE[OPENING_PHASE][WP][from+1];
-        base_score_endgame += PIECE_SQUARE_TABLE[ENDGAME_PHASE][WP][from+1];
-        break;
-      case -7:
-        // black en passant captures left
-        bitboard[WP] ^= (1L << (from - 1));
-        W ^= (1L << (from - 1));
-        piece_board[from + 7] = NONE;
-        piece_board[from - 1] = WP;
+    if (ep) {
+      // the captured pawn is next to the square we moved from, on the file we
+      // moved to:
+      int captured_square = (from & ~7) | (to & 7);
+      bitboard[captured] |= (1L << captured_square);
+      piece_board[captured_square] = captured;
+
+      if (turn == WHITE) W ^= (1L << captured_square);
+      else B ^= (1L << captured_square);
+    }
+    else {
+      bitboard[captured] |= (1L << to);
+      piece_board[to] = captured;
 
-        // hash in the captured pawn and update base score:
-        hash ^= ZOBRIST_SQUARE_KEYS[WP][from-1];
-        base_score_opening += PIECE_SQUARE_TABLE[OPENING_PHASE][WP][from-1];
-        base_score_endgame += PIECE_SQUARE_TABLE[ENDGAME_PHASE][WP][from-1];
-        break;
+      if (turn == WHITE) W ^= (1L << to);
+      else B ^= (1L << to);
     }
   }
 
@@ -625,11 +726,6 @@ void board::undo_move() {
         W ^= CWK_ROOK_MASK;
         piece_board[H1] = WR;
         piece_board[F1] = NONE;
-
-        // update hash and base_score:
-        base_score_opening -= CWK_ROOK_PST_DIFFERENCE_OPENING;
-        base_score_endgame -= CWK_ROOK_PST_DIFFERENCE_ENDGAME;
-        hash ^= CWK_ROOK_ZOBRIST;
         break;
       case C1:
         // white queenside castle
@@ -637,11 +733,6 @@ void board::undo_move() {
         W ^= CWQ_ROOK_MASK;
         piece_board[A1] = WR;
         piece_board[D1] = NONE;
-
-        // update hash and base_score:
-        base_score_opening -= CWQ_ROOK_PST_DIFFERENCE_OPENING;
-        base_score_endgame -= CWQ_ROOK_PST_DIFFERENCE_ENDGAME;
-        hash ^= CWQ_ROOK_ZOBRIST;
         break;
       case G8:
         // black kingside castle
@@ -649,11 +740,6 @@ void board::undo_move() {
         B ^= CBK_ROOK_MASK;
         piece_board[H8] = BR;
         piece_board[F8] = NONE;
-
-        // update hash and base_score:
-        base_score_opening -= CBK_ROOK_PST_DIFFERENCE_OPENING;
-        base_score_endgame -= CBK_ROOK_PST_DIFFERENCE_ENDGAME;
-        hash ^= CBK_ROOK_ZOBRIST;
         break;
       case C8:
         // black queenside castle
@@ -661,40 +747,20 @@ void board::undo_move() {
         B ^= CBQ_ROOK_MASK;
         piece_board[A8] = BR;
         piece_board[D8] = NONE;
-
-        // update hash and base_score:
-        base_score_opening -= CBQ_ROOK_PST_DIFFERENCE_OPENING;
-        base_score_endgame -= CBQ_ROOK_PST_DIFFERENCE_ENDGAME;
-        hash ^= CBQ_ROOK_ZOBRIST;
         break;
     }
   }
 
   if (promotion) {
-    // to which piece are we promoting?
-    int promoted_piece = (move >> 8) & 0xF;
-
-    // we need to remove the new piece:
+    // the promoted piece is what's on the 'to' square now (the pawn bit we
+    // toggled there above has to be toggled back):
+    int promoted_piece = MOVE_PROMOTION_PIECE(move);
     bitboard[piece_moved] ^= (1L << to);
     bitboard[promoted_piece] ^= (1L << to);
-    piece_board[to] = captured;
-
-    // update hash:
-    hash ^= ZOBRIST_SQUARE_KEYS[piece_moved][to];
-    hash ^= ZOBRIST_SQUARE_KEYS[promoted_piece][to];
-
-    // update base_score:
-    base_score_opening -= PIECE_SQUARE_TABLE[OPENING_PHASE][promoted_piece][to] - // new promotion piece
-                          PIECE_SQUARE_TABLE[OPENING_PHASE][piece_moved][to]; // pawn in promotion position
-    base_score_endgame -= PIECE_SQUARE_TABLE[ENDGAME_PHASE][promoted_piece][to] - // new promotion piece
-                          PIECE_SQUARE_TABLE[ENDGAME_PHASE][piece_moved][to]; // pawn in promotion position
-
-    game_phase_score -= GAME_PHASE_MATERIAL_SCORE[promoted_piece];
   }
 
   // flip the turn:
   turn = (turn == WHITE) ? BLACK : WHITE;
-  hash ^= ZOBRIST_TURN_KEY;
 }
 
 // print(): prints the board:
@@ -715,11 +781,20 @@ void board::print() {
   printf("\nturn: %c\n", (turn == WHITE) ? 'W' : 'B');
 }
 
+// make_nullmove(): passes the turn. the null move's history entry has no hash,
+// so repetition detection never looks past it:
 void board::make_nullmove() {
   turn = (turn == WHITE) ? BLACK : WHITE;
   hash ^= ZOBRIST_TURN_KEY;
-  repetition_history[ply] = 0L;
-  move_history[ply++] = NULL;
+  if (ply == (int) history.size()) history.emplace_back();
+  history[ply].move = NULL;
+  history[ply++].hash = 0L;
+
+  // the network's inputs don't change, so neither does its accumulator:
+  if (nnue_network) {
+    if ((int) accumulators.size() <= ply) accumulators.resize(ply + 1);
+    accumulators[ply] = accumulators[ply - 1];
+  }
 }
 
 void board::undo_nullmove() {
@@ -729,13 +804,13 @@ void board::undo_nullmove() {
 }
 
 // add all possible pawn moves to the stack:
-void board::add_pawn_moves(int* move_list, int& num_moves) {
+void board::add_nonquiet_pawn_moves(int* move_list, int& num_moves) {
   U64 moves;
   char idx;
   if (turn == WHITE) {
     // ----- look for captures in both directions: -----
     // every 1 in this bitboard corresponds to a piece that can be captured:
-    moves = (bitboard[WP] >> 7) & CAN_CAPTURE & ~RANKS[8] & ~FILES[A]; // capture right
+    moves = (bitboard[WP] >> 7) & CAN_CAPTURE & CHECK_MASK & ~RANKS[8] & ~FILES[A]; // capture right
 
     // bitscan to find these captures:
     while (moves) {
@@ -746,7 +821,7 @@ void board::add_pawn_moves(int* move_list, int& num_moves) {
       move_list[num_moves++] = move_int(idx, idx+7, piece_board[idx], castle_rights, WP);
     }
 
-    moves = (bitboard[WP] >> 9) & CAN_CAPTURE & ~RANKS[8] & ~FILES[H];  // capture left
+    moves = (bitboard[WP] >> 9) & CAN_CAPTURE & CHECK_MASK & ~RANKS[8] & ~FILES[H];  // capture left
 
     // bitscan to find these captures:
     while (moves) {
@@ -756,32 +831,8 @@ void board::add_pawn_moves(int* move_list, int& num_moves) {
       move_list[num_moves++] = move_int(idx, idx+9, piece_board[idx], castle_rights, WP);
     }
 
-    // ----- look for 1-square pawn push moves: -----
-    // every 1 in this bitboard corresponds to a square that a pawn can be pushed
-    // a single square forward to:
-    moves = (bitboard[WP] >> 8) & EMPTY_SQUARES & ~RANKS[8];
-
-    while (moves) {
-      idx = LSB(moves);
-      POP_LSB(moves);
-
-      move_list[num_moves++] = move_int(idx, idx+8, NONE, castle_rights, WP);
-    }
-
-    // ----- look for 2-square pawn push moves: -----
-    // every 1 in this bitboard corresponds to a 2-square pawn push:
-    moves = (bitboard[WP] >> 16) & EMPTY_SQUARES & (EMPTY_SQUARES >> 8) & RANKS[4];
-
-    while (moves) {
-      idx = LSB(moves);
-      POP_LSB(moves);
-
-      move_list[num_moves++] = move_int(idx, idx+16, NONE, 0, 1, 0,
-                                        0, NONE, castle_rights, WP);
-    }
-
     // ----- look for pawn promotion by push: -----
-    moves = (bitboard[WP] >> 8) & EMPTY_SQUARES & RANKS[8];
+    moves = (bitboard[WP] >> 8) & EMPTY_SQUARES & CHECK_MASK & RANKS[8];
 
     while (moves) {
       idx = LSB(moves);
@@ -798,7 +849,7 @@ void board::add_pawn_moves(int* move_list, int& num_moves) {
     }
 
     // ----- look for pawn promotion by capture: -----
-    moves = (bitboard[WP] >> 7) & CAN_CAPTURE & RANKS[8] & ~FILES[A]; // capture right
+    moves = (bitboard[WP] >> 7) & CAN_CAPTURE & CHECK_MASK & RANKS[8] & ~FILES[A]; // capture right
 
     while (moves) {
       idx = LSB(moves);
@@ -814,7 +865,7 @@ void board::add_pawn_moves(int* move_list, int& num_moves) {
                                         1, WB, castle_rights, WP);
     }
 
-    moves = (bitboard[WP] >> 9) & CAN_CAPTURE & RANKS[8] & ~FILES[H]; // capture left
+    moves = (bitboard[WP] >> 9) & CAN_CAPTURE & CHECK_MASK & RANKS[8] & ~FILES[H]; // capture left
 
     while (moves) {
       idx = LSB(moves);
@@ -831,8 +882,8 @@ void board::add_pawn_moves(int* move_list, int& num_moves) {
     }
 
     // ----- look for a possible en passant capture: -----
-    if (MOVE_IS_PAWNFIRST(move_history[ply-1])) {
-      char ep_file = FILE_NO(MOVE_TO(move_history[ply-1]));
+    if (ply && MOVE_IS_PAWNFIRST(history[ply-1].move)) {
+      char ep_file = FILE_NO(MOVE_TO(history[ply-1].move));
       // look for en passant to the right:
       moves = (bitboard[WP] << 1) & bitboard[BP] & RANKS[5] & ~FILES[A] & FILES[ep_file];
       if (moves) {
@@ -856,7 +907,7 @@ void board::add_pawn_moves(int* move_list, int& num_moves) {
   else {
     // ----- look for captures in both directions: -----
     // every 1 in this bitboard corresponds to a piece that can be captured:
-    moves = (bitboard[BP] << 7) & CAN_CAPTURE & ~RANKS[1] & ~FILES[H]; // capture left
+    moves = (bitboard[BP] << 7) & CAN_CAPTURE & CHECK_MASK & ~RANKS[1] & ~FILES[H]; // capture left
 
     // bitscan to find these captures:
     while (moves) {
@@ -866,7 +917,7 @@ void board::add_pawn_moves(int* move_list, int& num_moves) {
       move_list[num_moves++] = move_int(idx, idx-7, piece_board[idx], castle_rights, BP);
     }
 
-    moves = (bitboard[BP] << 9) & CAN_CAPTURE & ~RANKS[1] & ~FILES[A];  // capture right
+    moves = (bitboard[BP] << 9) & CAN_CAPTURE & CHECK_MASK & ~RANKS[1] & ~FILES[A];  // capture right
 
     // bitscan to find these captures:
     while (moves) {
@@ -876,32 +927,8 @@ void board::add_pawn_moves(int* move_list, int& num_moves) {
       move_list[num_moves++] = move_int(idx, idx-9, piece_board[idx], castle_rights, BP);
     }
 
-    // ----- look for 1-square pawn push moves: -----
-    // every 1 in this bitboard corresponds to a square that a pawn can be pushed
-    // a single square forward to:
-    moves = (bitboard[BP] << 8) & EMPTY_SQUARES & ~RANKS[1];
-
-    while (moves) {
-      idx = LSB(moves);
-      POP_LSB(moves);
-
-      move_list[num_moves++] = move_int(idx, idx-8, NONE, castle_rights, BP);
-    }
-
-    // ----- look for 2-square pawn push moves: -----
-    // every 1 in this bitboard corresponds to a 2-square pawn push:
-    moves = (bitboard[BP] << 16) & EMPTY_SQUARES & (EMPTY_SQUARES << 8) & RANKS[5];
-
-    while (moves) {
-      idx = LSB(moves);
-      POP_LSB(moves);
-
-      move_list[num_moves++] = move_int(idx, idx-16, NONE, 0, 1, 0,
-                                      0, NONE, castle_rights, BP);
-    }
-
     // ----- look for pawn promotion by push: -----
-    moves = (bitboard[BP] << 8) & EMPTY_SQUARES & RANKS[1];
+    moves = (bitboard[BP] << 8) & EMPTY_SQUARES & CHECK_MASK & RANKS[1];
 
     while (moves) {
       idx = LSB(moves);
@@ -918,7 +945,7 @@ void board::add_pawn_moves(int* move_list, int& num_moves) {
     }
 
     // ----- look for pawn promotion by capture: -----
-    moves = ((bitboard[BP] << 7) & CAN_CAPTURE & RANKS[1] & ~FILES[H]); // capture left
+    moves = ((bitboard[BP] << 7) & CAN_CAPTURE & CHECK_MASK & RANKS[1] & ~FILES[H]); // capture left
 
     while (moves) {
       idx = LSB(moves);
@@ -934,7 +961,7 @@ void board::add_pawn_moves(int* move_list, int& num_moves) {
                                         1, BB, castle_rights, BP);
     }
 
-    moves = (bitboard[BP] << 9) & CAN_CAPTURE & RANKS[1] & ~FILES[A]; // capture right
+    moves = (bitboard[BP] << 9) & CAN_CAPTURE & CHECK_MASK & RANKS[1] & ~FILES[A]; // capture right
 
     while (moves) {
       idx = LSB(moves);
@@ -951,8 +978,8 @@ void board::add_pawn_moves(int* move_list, int& num_moves) {
     }
 
     // ----- look for a possible en passant capture: -----
-    if (MOVE_IS_PAWNFIRST(move_history[ply-1])) {
-      char ep_file = FILE_NO(MOVE_TO(move_history[ply-1]));
+    if (ply && MOVE_IS_PAWNFIRST(history[ply-1].move)) {
+      char ep_file = FILE_NO(MOVE_TO(history[ply-1].move));
 
       // look for en passant capture to the right:
       moves = (bitboard[BP] << 1) & bitboard[WP] & RANKS[4] & ~FILES[A] & FILES[ep_file];
@@ -976,7 +1003,7 @@ void board::add_pawn_moves(int* move_list, int& num_moves) {
 }
 
 // add all possible bishop-like moves to the stack:
-void board::add_diag_moves(int* move_list, int& num_moves) {
+void board::add_nonquiet_diag_moves(int* move_list, int& num_moves) {
   // we include the queen in the 'bishop bitboard' and calculate queen moves as well:
   U64 bishop_bitboard = (turn == WHITE) ?
     bitboard[WB] | bitboard[WQ] :
@@ -990,22 +1017,21 @@ void board::add_diag_moves(int* move_list, int& num_moves) {
   U64 possible;
   char idx;
   char idx2;
+  char king_square = LSB(bitboard[KING + turn]);
 
   while (i) {
     idx = LSB(i);
-    possible = diag_moves_magic(idx, OCCUPIED_SQUARES) & CAN_MOVE_TO;
+    possible = diag_moves_magic(idx, OCCUPIED_SQUARES) & CAN_MOVE_TO & OCCUPIED_SQUARES & CHECK_MASK;
+
+    // a pinned slider can only move along the line it's pinned on:
+    if (PINNED & i) possible &= LINE_LOOKUP[king_square][idx];
 
     j = ISOLATE_LSB(possible);
     while (j) {
       idx2 = LSB(j);
 
-      // add the move to the move list. was a piece captured?
-      if (OCCUPIED_SQUARES & j) {
-        move_list[num_moves++] = move_int(idx2, idx, piece_board[idx2], castle_rights, piece_board[idx]);
-      }
-      else {
-        move_list[num_moves++] = move_int(idx2, idx, NONE, castle_rights, piece_board[idx]);
-      }
+      // add the move to the move list
+      move_list[num_moves++] = move_int(idx2, idx, piece_board[idx2], castle_rights, piece_board[idx]);
 
       // remove this position from possible (equivalent to POP_LSB macro but we already have j)
       possible &= ~j;
@@ -1018,7 +1044,7 @@ void board::add_diag_moves(int* move_list, int& num_moves) {
 }
 
 // add all possible rook-like moves to the stack:
-void board::add_line_moves(int* move_list, int& num_moves) {
+void board::add_nonquiet_line_moves(int* move_list, int& num_moves) {
   // we include the queen in the 'rook bitboard' and calculate queen moves as well:
   U64 rook_bitboard = (turn == WHITE) ?
     bitboard[WR] | bitboard[WQ] :
@@ -1032,22 +1058,21 @@ void board::add_line_moves(int* move_list, int& num_moves) {
   U64 possible;
   char idx;
   char idx2;
+  char king_square = LSB(bitboard[KING + turn]);
 
   while (i) {
     idx = LSB(i);
-    possible = line_moves_magic(idx, OCCUPIED_SQUARES) & CAN_MOVE_TO;
+    possible = line_moves_magic(idx, OCCUPIED_SQUARES) & CAN_MOVE_TO & OCCUPIED_SQUARES & CHECK_MASK;
+
+    // a pinned slider can only move along the line it's pinned on:
+    if (PINNED & i) possible &= LINE_LOOKUP[king_square][idx];
 
     j = ISOLATE_LSB(possible);
     while (j) {
       idx2 = LSB(j);
 
-      // add the move to the move list. was a piece captured?
-      if (OCCUPIED_SQUARES & j) {
-        move_list[num_moves++] = move_int(idx2, idx, piece_board[idx2], castle_rights, piece_board[idx]);
-      }
-      else {
-        move_list[num_moves++] = move_int(idx2, idx, NONE, castle_rights, piece_board[idx]);
-      }
+      // add the move to the move list
+      move_list[num_moves++] = move_int(idx2, idx, piece_board[idx2], castle_rights, piece_board[idx]);
 
       // remove this position from possible (equivalent to POP_LSB macro but we already have j)
       possible &= ~j;
@@ -1060,8 +1085,9 @@ void board::add_line_moves(int* move_list, int& num_moves) {
 }
 
 // add all possible knight moves to the stack:
-void board::add_knight_moves(int* move_list, int& num_moves) {
+void board::add_nonquiet_knight_moves(int* move_list, int& num_moves) {
   U64 knight_bitboard = (turn == WHITE) ? bitboard[WN] : bitboard[BN];
+  knight_bitboard &= ~PINNED; // a pinned knight can never move
 
   // in this nested loop, i loops through every individual knight on the board,
   // and j loops through every possible location that knight can travel to.
@@ -1076,19 +1102,14 @@ void board::add_knight_moves(int* move_list, int& num_moves) {
     idx = LSB(i);
 
     // figure out how to shift the knight span bitboard to get possible moves:
-    possible = KNIGHT_MOVES[idx] & CAN_MOVE_TO;
+    possible = KNIGHT_MOVES[idx] & CAN_MOVE_TO & OCCUPIED_SQUARES & CHECK_MASK;
 
     j = ISOLATE_LSB(possible);
     while (j) {
       idx2 = LSB(j);
 
-      // add the move to the move list. was a piece captured?
-      if (OCCUPIED_SQUARES & j) {
-        move_list[num_moves++] = move_int(idx2, idx, piece_board[idx2], castle_rights, KNIGHT + turn);
-      }
-      else {
-        move_list[num_moves++] = move_int(idx2, idx, NONE, castle_rights, KNIGHT + turn);
-      }
+      // add the move to the move list
+      move_list[num_moves++] = move_int(idx2, idx, piece_board[idx2], castle_rights, KNIGHT + turn);
 
       // remove this position from possible (equivalent to POP_LSB macro but we already have j)
       possible &= ~j;
@@ -1100,392 +1121,201 @@ void board::add_knight_moves(int* move_list, int& num_moves) {
   }
 }
 
-// add all possible knight moves to the stack:
-void board::add_king_moves(int* move_list, int& num_moves) {
+// add all possible king moves to the stack:
+void board::add_nonquiet_king_moves(int* move_list, int& num_moves) {
   U64 king_bitboard = (turn == WHITE) ? bitboard[WK] : bitboard[BK];
   char idx = LSB(king_bitboard);
   char idx2;
 
   // figure out how to shift the king span bitboard to get possible moves:
-  U64 possible = KING_MOVES[idx] & CAN_MOVE_TO;
+  U64 possible = KING_MOVES[idx] & CAN_MOVE_TO & OCCUPIED_SQUARES & ~UNSAFE;
 
   U64 j = ISOLATE_LSB(possible);
   while (j) {
     idx2 = LSB(j);
 
-    // add the move to the move list. was a piece captured?
-    if (OCCUPIED_SQUARES & j) {
-      move_list[num_moves++] = move_int(idx2, idx, piece_board[idx2], castle_rights, KING + turn);
-    }
-    else {
-      move_list[num_moves++] = move_int(idx2, idx, NONE, castle_rights, KING + turn);
-    }
+    // add the move to the move list
+    move_list[num_moves++] = move_int(idx2, idx, piece_board[idx2], castle_rights, KING + turn);
 
     // remove this position from possible (equivalent to POP_LSB macro but we already have j)
     possible &= ~j;
     j = ISOLATE_LSB(possible);
   }
+}
 
-  // get castling moves:
-  if (!(UNSAFE & bitboard[KING + turn])) {
-    if (turn == WHITE) {
-      // check for kingside castle:
-      if (CAN_CWK(castle_rights) && !((OCCUPIED_SQUARES | UNSAFE) & CWK_SAFE_SPACES)) {
-        move_list[num_moves++] = move_int(62, 60, NONE, 0, 0, 1, 0,
-                                          NONE, castle_rights, WK);
-      }
+// add all quiet (non-capture, non-promotion) pawn moves to the stack:
+void board::add_quiet_pawn_moves(int* move_list, int& num_moves) {
+  U64 moves;
+  char idx;
+  if (turn == WHITE) {
+    // ----- look for 1-square pawn push moves: -----
+    moves = (bitboard[WP] >> 8) & EMPTY_SQUARES & CHECK_MASK & ~RANKS[8];
 
-      // check for queenside castle:
-      if (CAN_CWQ(castle_rights) && !((UNSAFE & CWQ_SAFE_SPACES) || (OCCUPIED_SQUARES & CWQ_EMPTY_SPACES))) {
-        move_list[num_moves++] = move_int(58, 60, NONE, 0, 0, 1, 0,
-                                          NONE, castle_rights, WK);
-      }
+    while (moves) {
+      idx = LSB(moves);
+      POP_LSB(moves);
+
+      move_list[num_moves++] = move_int(idx, idx+8, NONE, castle_rights, WP);
     }
 
-    else {
-      // check for kingside castle:
-      if (CAN_CBK(castle_rights) && !((OCCUPIED_SQUARES | UNSAFE) & CBK_SAFE_SPACES)) {
-        move_list[num_moves++] = move_int(6, 4, NONE, 0, 0, 1, 0,
-                                          NONE, castle_rights, BK);
-      }
-
-      // check for queenside castle:
-      if (CAN_CBQ(castle_rights) && !((UNSAFE & CBQ_SAFE_SPACES) || (OCCUPIED_SQUARES & CBQ_EMPTY_SPACES))) {
-        move_list[num_moves++] = move_int(2, 4, NONE, 0, 0, 1, 0,
-                                          NONE, castle_rights, BK);
-      }
-    }
-  }
-}
-
-// add all possible pawn moves to the stack:
-void board::add_nonquiet_pawn_moves(int* move_list, int& num_moves) {
-  U64 moves;
-  char idx;
-  if (turn == WHITE) {
-    // ----- look for captures in both directions: -----
-    // every 1 in this bitboard corresponds to a piece that can be captured:
-    moves = (bitboard[WP] >> 7) & CAN_CAPTURE & ~RANKS[8] & ~FILES[A]; // capture right
-
-    // bitscan to find these captures:
-    while (moves) {
-      idx = LSB(moves);
-      POP_LSB(moves);
-
-      // the captured piece is piece_board[idx]
-      move_list[num_moves++] = move_int(idx, idx+7, piece_board[idx], castle_rights, WP);
-    }
-
-    moves = (bitboard[WP] >> 9) & CAN_CAPTURE & ~RANKS[8] & ~FILES[H];  // capture left
-
-    // bitscan to find these captures:
-    while (moves) {
-      idx = LSB(moves);
-      POP_LSB(moves);
-
-      move_list[num_moves++] = move_int(idx, idx+9, piece_board[idx], castle_rights, WP);
-    }
-
-    // ----- look for pawn promotion by push: -----
-    moves = (bitboard[WP] >> 8) & EMPTY_SQUARES & RANKS[8];
+    // ----- look for 2-square pawn push moves: -----
+    moves = (bitboard[WP] >> 16) & EMPTY_SQUARES & CHECK_MASK & (EMPTY_SQUARES >> 8) & RANKS[4];
 
     while (moves) {
       idx = LSB(moves);
       POP_LSB(moves);
 
-      move_list[num_moves++] = move_int(idx, idx+8, NONE, 0, 0, 0,
-                                        1, WQ, castle_rights, WP);
-      move_list[num_moves++] = move_int(idx, idx+8, NONE, 0, 0, 0,
-                                        1, WN, castle_rights, WP);
-      move_list[num_moves++] = move_int(idx, idx+8, NONE, 0, 0, 0,
-                                        1, WR, castle_rights, WP);
-      move_list[num_moves++] = move_int(idx, idx+8, NONE, 0, 0, 0,
-                                        1, WB, castle_rights, WP);
-    }
-
-    // ----- look for pawn promotion by capture: -----
-    moves = (bitboard[WP] >> 7) & CAN_CAPTURE & RANKS[8] & ~FILES[A]; // capture right
-
-    while (moves) {
-      idx = LSB(moves);
-      POP_LSB(moves);
-
-      move_list[num_moves++] = move_int(idx, idx+7, piece_board[idx], 0, 0, 0,
-                                        1, WQ, castle_rights, WP);
-      move_list[num_moves++] = move_int(idx, idx+7, piece_board[idx], 0, 0, 0,
-                                        1, WN, castle_rights, WP);
-      move_list[num_moves++] = move_int(idx, idx+7, piece_board[idx], 0, 0, 0,
-                                        1, WR, castle_rights, WP);
-      move_list[num_moves++] = move_int(idx, idx+7, piece_board[idx], 0, 0, 0,
-                                        1, WB, castle_rights, WP);
-    }
-
-    moves = (bitboard[WP] >> 9) & CAN_CAPTURE & RANKS[8] & ~FILES[H]; // capture left
-
-    while (moves) {
-      idx = LSB(moves);
-      POP_LSB(moves);
-
-      move_list[num_moves++] = move_int(idx, idx+9, piece_board[idx], 0, 0, 0,
-                                        1, WQ, castle_rights, WP);
-      move_list[num_moves++] = move_int(idx, idx+9, piece_board[idx], 0, 0, 0,
-                                        1, WN, castle_rights, WP);
-      move_list[num_moves++] = move_int(idx, idx+9, piece_board[idx], 0, 0, 0,
-                                        1, WR, castle_rights, WP);
-      move_list[num_moves++] = move_int(idx, idx+9, piece_board[idx], 0, 0, 0,
-                                        1, WB, castle_rights, WP);
-    }
-
-    // ----- look for a possible en passant capture: -----
-    if (MOVE_IS_PAWNFIRST(move_history[ply-1])) {
-      char ep_file = FILE_NO(MOVE_TO(move_history[ply-1]));
-      // look for en passant to the right:
-      moves = (bitboard[WP] << 1) & bitboard[BP] & RANKS[5] & ~FILES[A] & FILES[ep_file];
-      if (moves) {
-        idx = LSB(moves);
-
-        move_list[num_moves++] = move_int(idx-8, idx-1, BP, 1, 0, 0,
-                                          0, NONE, castle_rights, WP);
-      }
-
-      // look for en passant to the left:
-      moves = (bitboard[WP] >> 1) & bitboard[BP] & RANKS[5] & ~FILES[H] & FILES[ep_file];
-      if (moves) {
-        idx = LSB(moves);
-
-        move_list[num_moves++] = move_int(idx-8, idx+1, BP, 1, 0, 0,
-                                          0, NONE, castle_rights, WP);
-      }
+      move_list[num_moves++] = move_int(idx, idx+16, NONE, 0, 1, 0,
+                                        0, NONE, castle_rights, WP);
     }
   }
 
   else {
-    // ----- look for captures in both directions: -----
-    // every 1 in this bitboard corresponds to a piece that can be captured:
-    moves = (bitboard[BP] << 7) & CAN_CAPTURE & ~RANKS[1] & ~FILES[H]; // capture left
-
-    // bitscan to find these captures:
-    while (moves) {
-      idx = LSB(moves);
-      POP_LSB(moves);
-
-      move_list[num_moves++] = move_int(idx, idx-7, piece_board[idx], castle_rights, BP);
-    }
-
-    moves = (bitboard[BP] << 9) & CAN_CAPTURE & ~RANKS[1] & ~FILES[A];  // capture right
-
-    // bitscan to find these captures:
-    while (moves) {
-      idx = LSB(moves);
-      POP_LSB(moves);
-
-      move_list[num_moves++] = move_int(idx, idx-9, piece_board[idx], castle_rights, BP);
-    }
-
-    // ----- look for pawn promotion by push: -----
-    moves = (bitboard[BP] << 8) & EMPTY_SQUARES & RANKS[1];
-
-    while (moves) {
-      idx = LSB(moves);
-      POP_LSB(moves);
-
-      move_list[num_moves++] = move_int(idx, idx-8, NONE, 0, 0, 0,
-                                        1, BQ, castle_rights, BP);
-      move_list[num_moves++] = move_int(idx, idx-8, NONE, 0, 0, 0,
-                                        1, BN, castle_rights, BP);
-      move_list[num_moves++] = move_int(idx, idx-8, NONE, 0, 0, 0,
-                                        1, BR, castle_rights, BP);
-      move_list[num_moves++] = move_int(idx, idx-8, NONE, 0, 0, 0,
-                                        1, BB, castle_rights, BP);
-    }
-
-    // ----- look for pawn promotion by capture: -----
-    moves = ((bitboard[BP] << 7) & CAN_CAPTURE & RANKS[1] & ~FILES[H]); // capture left
+    // ----- look for 1-square pawn push moves: -----
+    moves = (bitboard[BP] << 8) & EMPTY_SQUARES & CHECK_MASK & ~RANKS[1];
 
     while (moves) {
       idx = LSB(moves);
       POP_LSB(moves);
 
-      move_list[num_moves++] = move_int(idx, idx-7, piece_board[idx], 0, 0, 0,
-                                        1, BQ, castle_rights, BP);
-      move_list[num_moves++] = move_int(idx, idx-7, piece_board[idx], 0, 0, 0,
-                                        1, BN, castle_rights, BP);
-      move_list[num_moves++] = move_int(idx, idx-7, piece_board[idx], 0, 0, 0,
-                                        1, BR, castle_rights, BP);
-      move_list[num_moves++] = move_int(idx, idx-7, piece_board[idx], 0, 0, 0,
-                                        1, BB, castle_rights, BP);
+      move_list[num_moves++] = move_int(idx, idx-8, NONE, castle_rights, BP);
     }
 
-    moves = (bitboard[BP] << 9) & CAN_CAPTURE & RANKS[1] & ~FILES[A]; // capture right
+    // ----- look for 2-square pawn push moves: -----
+    moves = (bitboard[BP] << 16) & EMPTY_SQUARES & CHECK_MASK & (EMPTY_SQUARES << 8) & RANKS[5];
 
     while (moves) {
       idx = LSB(moves);
       POP_LSB(moves);
 
-      move_list[num_moves++] = move_int(idx, idx-9, piece_board[idx], 0, 0, 0,
-                                        1, BQ, castle_rights, BP);
-      move_list[num_moves++] = move_int(idx, idx-9, piece_board[idx], 0, 0, 0,
-                                        1, BN, castle_rights, BP);
-      move_list[num_moves++] = move_int(idx, idx-9, piece_board[idx], 0, 0, 0,
-                                        1, BR, castle_rights, BP);
-      move_list[num_moves++] = move_int(idx, idx-9, piece_board[idx], 0, 0, 0,
-                                        1, BB, castle_rights, BP);
-    }
-
-    // ----- look for a possible en passant capture: -----
-    if (MOVE_IS_PAWNFIRST(move_history[ply-1])) {
-      char ep_file = FILE_NO(MOVE_TO(move_history[ply-1]));
-
-      // look for en passant capture to the right:
-      moves = (bitboard[BP] << 1) & bitboard[WP] & RANKS[4] & ~FILES[A] & FILES[ep_file];
-      if (moves) {
-        idx = LSB(moves);
-
-        move_list[num_moves++] = move_int(idx+8, idx-1, WP, 1, 0, 0,
-                                          0, NONE, castle_rights, BP);
-      }
-
-      // look for en passant capture to the left:
-      moves = (bitboard[BP] >> 1) & bitboard[WP] & RANKS[4] & ~FILES[H] & FILES[ep_file];
-      if (moves) {
-        idx = LSB(moves);
-
-        move_list[num_moves++] = move_int(idx+8, idx+1, WP, 1, 0, 0,
-                                          0, NONE, castle_rights, BP);
-      }
+      move_list[num_moves++] = move_int(idx, idx-16, NONE, 0, 1, 0,
+                                        0, NONE, castle_rights, BP);
     }
   }
 }
 
-// add all possible bishop-like moves to the stack:
-void board::add_nonquiet_diag_moves(int* move_list, int& num_moves) {
+// add all quiet bishop-like moves to the stack:
+void board::add_quiet_diag_moves(int* move_list, int& num_moves) {
   // we include the queen in the 'bishop bitboard' and calculate queen moves as well:
   U64 bishop_bitboard = (turn == WHITE) ?
     bitboard[WB] | bitboard[WQ] :
     bitboard[BB] | bitboard[BQ];
 
-  // in this nested loop, i loops through every individual bishop on the board,
-  // and j loops through every possible location that bishop can travel to.
-  // idx and idx2 represent the beginning and ending square indices of each move, respectively
-  U64 i = ISOLATE_LSB(bishop_bitboard);
-  U64 j;
   U64 possible;
   char idx;
   char idx2;
+  char king_square = LSB(bitboard[KING + turn]);
 
-  while (i) {
-    idx = LSB(i);
-    possible = diag_moves_magic(idx, OCCUPIED_SQUARES) & CAN_MOVE_TO & OCCUPIED_SQUARES;
+  while (bishop_bitboard) {
+    idx = LSB(bishop_bitboard);
+    POP_LSB(bishop_bitboard);
+    possible = diag_moves_magic(idx, OCCUPIED_SQUARES) & EMPTY_SQUARES & CHECK_MASK;
 
-    j = ISOLATE_LSB(possible);
-    while (j) {
-      idx2 = LSB(j);
+    // a pinned slider can only move along the line it's pinned on:
+    if (PINNED & (1L << idx)) possible &= LINE_LOOKUP[king_square][idx];
 
-      // add the move to the move list
-      move_list[num_moves++] = move_int(idx2, idx, piece_board[idx2], castle_rights, piece_board[idx]);
+    while (possible) {
+      idx2 = LSB(possible);
+      POP_LSB(possible);
 
-      // remove this position from possible (equivalent to POP_LSB macro but we already have j)
-      possible &= ~j;
-      j = ISOLATE_LSB(possible);
+      move_list[num_moves++] = move_int(idx2, idx, NONE, castle_rights, piece_board[idx]);
     }
-
-    bishop_bitboard &= ~i;
-    i = ISOLATE_LSB(bishop_bitboard);
   }
 }
 
-// add all possible rook-like moves to the stack:
-void board::add_nonquiet_line_moves(int* move_list, int& num_moves) {
+// add all quiet rook-like moves to the stack:
+void board::add_quiet_line_moves(int* move_list, int& num_moves) {
   // we include the queen in the 'rook bitboard' and calculate queen moves as well:
   U64 rook_bitboard = (turn == WHITE) ?
     bitboard[WR] | bitboard[WQ] :
     bitboard[BR] | bitboard[BQ];
 
-  // in this nested loop, i loops through every individual rook on the board,
-  // and j loops through every possible location that rook can travel to.
-  // idx and idx2 represent the beginning and ending square indices of each move, respectively
-  U64 i = ISOLATE_LSB(rook_bitboard);
-  U64 j;
   U64 possible;
   char idx;
   char idx2;
+  char king_square = LSB(bitboard[KING + turn]);
 
-  while (i) {
-    idx = LSB(i);
-    possible = line_moves_magic(idx, OCCUPIED_SQUARES) & CAN_MOVE_TO & OCCUPIED_SQUARES;
+  while (rook_bitboard) {
+    idx = LSB(rook_bitboard);
+    POP_LSB(rook_bitboard);
+    possible = line_moves_magic(idx, OCCUPIED_SQUARES) & EMPTY_SQUARES & CHECK_MASK;
 
-    j = ISOLATE_LSB(possible);
-    while (j) {
-      idx2 = LSB(j);
+    // a pinned slider can only move along the line it's pinned on:
+    if (PINNED & (1L << idx)) possible &= LINE_LOOKUP[king_square][idx];
 
-      // add the move to the move list
-      move_list[num_moves++] = move_int(idx2, idx, piece_board[idx2], castle_rights, piece_board[idx]);
+    while (possible) {
+      idx2 = LSB(possible);
+      POP_LSB(possible);
 
-      // remove this position from possible (equivalent to POP_LSB macro but we already have j)
-      possible &= ~j;
-      j = ISOLATE_LSB(possible);
+      move_list[num_moves++] = move_int(idx2, idx, NONE, castle_rights, piece_board[idx]);
     }
-
-    rook_bitboard &= ~i;
-    i = ISOLATE_LSB(rook_bitboard);
   }
 }
 
-// add all possible knight moves to the stack:
-void board::add_nonquiet_knight_moves(int* move_list, int& num_moves) {
+// add all quiet knight moves to the stack:
+void board::add_quiet_knight_moves(int* move_list, int& num_moves) {
   U64 knight_bitboard = (turn == WHITE) ? bitboard[WN] : bitboard[BN];
-
-  // in this nested loop, i loops through every individual knight on the board,
-  // and j loops through every possible location that knight can travel to.
-  // idx and idx2 represent the beginning and ending square indices of each move, respectively
-  U64 i = ISOLATE_LSB(knight_bitboard);
-  U64 j;
+  knight_bitboard &= ~PINNED; // a pinned knight can never move
   U64 possible;
   char idx;
   char idx2;
 
-  while (i) {
-    idx = LSB(i);
+  while (knight_bitboard) {
+    idx = LSB(knight_bitboard);
+    POP_LSB(knight_bitboard);
+    possible = KNIGHT_MOVES[idx] & EMPTY_SQUARES & CHECK_MASK;
 
-    // figure out how to shift the knight span bitboard to get possible moves:
-    possible = KNIGHT_MOVES[idx] & CAN_MOVE_TO & OCCUPIED_SQUARES;
+    while (possible) {
+      idx2 = LSB(possible);
+      POP_LSB(possible);
 
-    j = ISOLATE_LSB(possible);
-    while (j) {
-      idx2 = LSB(j);
-
-      // add the move to the move list
-      move_list[num_moves++] = move_int(idx2, idx, piece_board[idx2], castle_rights, KNIGHT + turn);
-
-      // remove this position from possible (equivalent to POP_LSB macro but we already have j)
-      possible &= ~j;
-      j = ISOLATE_LSB(possible);
+      move_list[num_moves++] = move_int(idx2, idx, NONE, castle_rights, KNIGHT + turn);
     }
-
-    knight_bitboard &= ~i;
-    i = ISOLATE_LSB(knight_bitboard);
   }
 }
 
-// add all possible knight moves to the stack:
-void board::add_nonquiet_king_moves(int* move_list, int& num_moves) {
-  U64 king_bitboard = (turn == WHITE) ? bitboard[WK] : bitboard[BK];
-  char idx = LSB(king_bitboard);
+// add all quiet king moves (including castling) to the stack:
+void board::add_quiet_king_moves(int* move_list, int& num_moves) {
+  char idx = LSB(bitboard[KING + turn]);
   char idx2;
+  U64 possible = KING_MOVES[idx] & EMPTY_SQUARES & ~UNSAFE;
 
-  // figure out how to shift the king span bitboard to get possible moves:
-  U64 possible = KING_MOVES[idx] & CAN_MOVE_TO & OCCUPIED_SQUARES;
+  while (possible) {
+    idx2 = LSB(possible);
+    POP_LSB(possible);
 
-  U64 j = ISOLATE_LSB(possible);
-  while (j) {
-    idx2 = LSB(j);
+    move_list[num_moves++] = move_int(idx2, idx, NONE, castle_rights, KING + turn);
+  }
 
-    // add the move to the move list
-    move_list[num_moves++] = move_int(idx2, idx, piece_board[idx2], castle_rights, KING + turn);
+  // get castling moves:
+  if (!(UNSAFE & bitboard[KING + turn])) {
+    if (turn == WHITE) {
+      // check for kingside castle:
+      if (CAN_CWK(castle_rights) && !((OCCUPIED_SQUARES | UNSAFE) & CWK_SAFE_SPACES)) {
+        move_list[num_moves++] = move_int(62, 60, NONE, 0, 0, 1, 0,
+                                          NONE, castle_rights, WK);
+      }
 
-    // remove this position from possible (equivalent to POP_LSB macro but we already have j)
-    possible &= ~j;
-    j = ISOLATE_LSB(possible);
+      // check for queenside castle:
+      if (CAN_CWQ(castle_rights) && !((UNSAFE & CWQ_SAFE_SPACES) || (OCCUPIED_SQUARES & CWQ_EMPTY_SPACES))) {
+        move_list[num_moves++] = move_int(58, 60, NONE, 0, 0, 1, 0,
+                                          NONE, castle_rights, WK);
+      }
+    }
+
+    else {
+      // check for kingside castle:
+      if (CAN_CBK(castle_rights) && !((OCCUPIED_SQUARES | UNSAFE) & CBK_SAFE_SPACES)) {
+        move_list[num_moves++] = move_int(6, 4, NONE, 0, 0, 1, 0,
+                                          NONE, castle_rights, BK);
+      }
+
+      // check for queenside castle:
+      if (CAN_CBQ(castle_rights) && !((UNSAFE & CBQ_SAFE_SPACES) || (OCCUPIED_SQUARES & CBQ_EMPTY_SPACES))) {
+        move_list[num_moves++] = move_int(2, 4, NONE, 0, 0, 1, 0,
+                                          NONE, castle_rights, BK);
+      }
+    }
   }
 }
 
@@ -1505,8 +1335,11 @@ U64 board::get_attackers(U64 occupied, int sq) {
 }
 
 // update_move_info_bitboards(): updates the move info bitboards (which pieces can
-// and can't be captured, etc.)
+// and can't be captured, etc.). the attack maps come from this ply's attack
+// cache if we already computed them for this position:
 void board::update_move_info_bitboards() {
+  PROFILE(PROFILE_MOVE_INFO);
+
   if (turn == WHITE) {
     CANT_CAPTURE = W;
     CAN_CAPTURE  = B;
@@ -1520,88 +1353,127 @@ void board::update_move_info_bitboards() {
   OCCUPIED_SQUARES = CAN_CAPTURE | CANT_CAPTURE;
   EMPTY_SQUARES = ~OCCUPIED_SQUARES;
 
-  update_unsafe();
-}
+  if ((int) attack_cache.size() <= ply) attack_cache.resize(ply + 1);
+  attack_info& info = attack_cache[ply];
+  if (info.key != hash) update_attacks(info);
 
-void board::update_unsafe() {
-  int NOT_TURN = (turn == WHITE) ? BLACK : WHITE;
+  // the checker and pin masks for legal move generation:
+  UNSAFE = info.unsafe;
+  CHECKERS = info.checkers;
+  PINNED = info.pinned[turn == WHITE ? 0 : 1];
 
-  U64 opp_knight = bitboard[KNIGHT + NOT_TURN];
-  U64 opp_king = bitboard[KING + NOT_TURN];
-  U64 opp_QB = bitboard[QUEEN + NOT_TURN] | bitboard[BISHOP + NOT_TURN];
-  U64 opp_QR = bitboard[QUEEN + NOT_TURN] | bitboard[ROOK + NOT_TURN];
+  if (!CHECKERS) CHECK_MASK = ~0L;
+  else if (SEVERAL(CHECKERS)) CHECK_MASK = 0L;
+  else CHECK_MASK = RECT_LOOKUP[LSB(bitboard[KING + turn])][LSB(CHECKERS)] | CHECKERS;
+}
 
+// add_attacks(): fills in the attack maps of one side's pieces. the sliders'
+// attacks are computed with the given occupancy:
+void board::add_attacks(attack_info& info, int side, U64 occupied) {
   // pawn attacks:
-  if (turn == WHITE) {
-    UNSAFE  = ((bitboard[BP] << 7) & ~FILES[H]);
-    UNSAFE |= ((bitboard[BP] << 9) & ~FILES[A]);
+  if (side == WHITE) {
+    info.attacks[WP] = ((bitboard[WP] >> 7) & ~FILES[A]) | ((bitboard[WP] >> 9) & ~FILES[H]);
   }
   else {
-    UNSAFE  = ((bitboard[WP] >> 7) & ~FILES[A]);
-    UNSAFE |= ((bitboard[WP] >> 9) & ~FILES[H]);
+    info.attacks[BP] = ((bitboard[BP] << 7) & ~FILES[H]) | ((bitboard[BP] << 9) & ~FILES[A]);
   }
 
   // knight attacks:
-  U64 possible;
-  char idx;
-  U64 i = ISOLATE_LSB(opp_knight);
-
-  while (i) {
-    idx = LSB(i);
-    possible = KNIGHT_MOVES[idx];
-    UNSAFE |= possible;
-
-    opp_knight &= ~i;
-    i = ISOLATE_LSB(opp_knight);
+  U64 pieces = bitboard[KNIGHT + side];
+  info.attacks[KNIGHT + side] = 0L;
+  while (pieces) {
+    info.attacks[KNIGHT + side] |= KNIGHT_MOVES[LSB(pieces)];
+    POP_LSB(pieces);
   }
 
-  // queen / bishop attacks diagonally:
-  i = ISOLATE_LSB(opp_QB);
-  while (i) {
-    idx = LSB(i);
-    possible = diag_moves_magic(idx, OCCUPIED_SQUARES);
-    UNSAFE |= possible;
-
-    opp_QB &= ~i;
-    i = ISOLATE_LSB(opp_QB);
+  // bishop attacks:
+  pieces = bitboard[BISHOP + side];
+  info.attacks[BISHOP + side] = 0L;
+  while (pieces) {
+    info.attacks[BISHOP + side] |= diag_moves_magic(LSB(pieces), occupied);
+    POP_LSB(pieces);
   }
 
-  // queen / rook attacks horizontally / vertically:
-  i = ISOLATE_LSB(opp_QR);
-  while (i) {
-    idx = LSB(i);
-    possible = line_moves_magic(idx, OCCUPIED_SQUARES);
-    UNSAFE |= possible;
+  // rook attacks:
+  pieces = bitboard[ROOK + side];
+  info.attacks[ROOK + side] = 0L;
+  while (pieces) {
+    info.attacks[ROOK + side] |= line_moves_magic(LSB(pieces), occupied);
+    POP_LSB(pieces);
+  }
 
-    opp_QR &= ~i;
-    i = ISOLATE_LSB(opp_QR);
+  // queen attacks:
+  pieces = bitboard[QUEEN + side];
+  info.attacks[QUEEN + side] = 0L;
+  while (pieces) {
+    char idx = LSB(pieces);
+    info.attacks[QUEEN + side] |= diag_moves_magic(idx, occupied) | line_moves_magic(idx, occupied);
+    POP_LSB(pieces);
   }
 
   // king attacks:
-  idx = LSB(opp_king);
-  possible = KING_MOVES[idx];
-  UNSAFE |= possible;
+  info.attacks[KING + side] = KING_MOVES[LSB(bitboard[KING + side])];
 }
 
-// pinned_pieces(): returns a bitboard of all pinned pieces
-U64 board::pinned_pieces() {
-  char king_square = LSB(bitboard[KING + turn]);
+// update_attacks(): computes the attack maps of this position. we always need
+// the opponent's attacks (the UNSAFE squares), whose sliders see through our
+// king, so that the king can't step back along the line of a check. the side
+// to move's attacks are only filled in when attacks() asks for them:
+void board::update_attacks(attack_info& info) {
   int not_turn = (turn == WHITE) ? BLACK : WHITE;
-  U64 blockers = CANT_CAPTURE;
+  add_attacks(info, not_turn, (W | B) ^ bitboard[KING + turn]);
+
+  info.unsafe = 0L;
+  for (int piece = PAWN; piece <= KING; piece++) info.unsafe |= info.attacks[piece + not_turn];
 
-  U64 pinned = 0L;
-  U64 pinner = (xray_rook(OCCUPIED_SQUARES, blockers, king_square) &
-               (bitboard[ROOK + not_turn] | bitboard[QUEEN + not_turn])) |
-               (xray_bishop(OCCUPIED_SQUARES, blockers, king_square) &
-               (bitboard[BISHOP + not_turn] | bitboard[QUEEN + not_turn]));
+  info.checkers = (info.unsafe & bitboard[KING + turn]) ? get_checkers() : 0L;
+  get_pins(WHITE, info.pinned[0], info.pinners[0]);
+  get_pins(BLACK, info.pinned[1], info.pinners[1]);
+  info.complete = false;
+  info.key = hash;
+}
+
+// attacks(): the attack maps of the current position. if complete is set, the
+// attacks of the side to move are filled in as well:
+const attack_info& board::attacks(bool complete) {
+  if ((int) attack_cache.size() <= ply || attack_cache[ply].key != hash) update_move_info_bitboards();
+
+  attack_info& info = attack_cache[ply];
+  if (complete && !info.complete) {
+    add_attacks(info, turn, W | B);
+    info.complete = true;
+  }
+  return info;
+}
 
+// get_pins(): the given side's pieces pinned to its king, and the enemy
+// sliders pinning them:
+void board::get_pins(int side, U64& pinned, U64& pinners) {
+  char king_square = LSB(bitboard[KING + side]);
+  int enemy = (side == WHITE) ? BLACK : WHITE;
+  U64 blockers = (side == WHITE) ? W : B;
+  U64 occupied = W | B;
+
+  pinned = 0L;
+  pinners = (xray_rook(occupied, blockers, king_square) &
+            (bitboard[ROOK + enemy] | bitboard[QUEEN + enemy])) |
+            (xray_bishop(occupied, blockers, king_square) &
+            (bitboard[BISHOP + enemy] | bitboard[QUEEN + enemy]));
+
+  U64 pinner = pinners;
   while (pinner) {
     int sq  = LSB(pinner);
     pinned |= RECT_LOOKUP[sq][king_square] & blockers;
     POP_LSB(pinner);
   }
+}
 
-  return pinned;
+// get_checkers(): returns a bitboard of all opponent pieces giving check. unlike
+// is_check(), this doesn't depend on the move info bitboards:
+U64 board::get_checkers() {
+  U64 opponent = (turn == WHITE) ? B : W;
+  U64 king = bitboard[KING + turn];
+  return get_attackers(W | B, LSB(king)) & opponent;
 }
 
 // is_check(): ASSUMES UNSAFE BITBOARD HAS BEEN UPDATED (which it is if we've
@@ -1614,7 +1486,7 @@ bool board::is_repetition() {
   // try to find two other instances of the current position in our repetition history list:
   int repetitions = 0;
   for (int i = 0; i < ply; i++) {
-    if (repetition_history[i] == hash) {
+    if (history[i].hash == hash) {
       repetitions++;
       if (repetitions == 2) break;
     }
@@ -1622,18 +1494,6 @@ bool board::is_repetition() {
   return (repetitions >= 2) && ply;
 }
 
-bool board::is_material_draw() {
-  U64 pawns = bitboard[WP] | bitboard[BP];
-  U64 knights = bitboard[WN] | bitboard[BN];
-  U64 bishops = bitboard[WB] | bitboard[BB];
-  U64 rooks = bitboard[WR] | bitboard[BR];
-  U64 queens = bitboard[WQ] | bitboard[BQ];
-
-  return (!(pawns | rooks | queens)) &&
-         (!SEVERAL(W) || !SEVERAL(B)) &&
-         (!SEVERAL(knights | bishops) || (!bishops && POPCOUNT(knights) <= 2));
-}
-
 /* ---------- BOARD UTILITY FUNCTIONS ---------- */
 
 // generates a move integer:
@@ -1678,6 +1538,18 @@ U64 diag_moves(char s, U64 OCCUPIED) {
   return diag | antidiag;
 }
 
+#ifdef USE_PEXT
+// line_moves_magic(): same as line_moves() but using a PEXT table lookup (built
+// with make PEXT=1, for CPUs with fast BMI2):
+U64 line_moves_magic(char s, U64 OCCUPIED) {
+  return SLIDER_TABLE[ROOK_OFFSETS[s] + _pext_u64(OCCUPIED, ROOK_MASKS[s])];
+}
+
+// diag_moves_magic(): same as diag_moves() but using a PEXT table lookup:
+U64 diag_moves_magic(char s, U64 OCCUPIED) {
+  return SLIDER_TABLE[BISHOP_OFFSETS[s] + _pext_u64(OCCUPIED, BISHOP_MASKS[s])];
+}
+#else
 // line_moves_magic(): same as line_moves() but using magic bitboards (so much faster).
 U64 line_moves_magic(char s, U64 OCCUPIED) {
   // mask out anything not in the possible attack set:
@@ -1701,6 +1573,7 @@ U64 diag_moves_magic(char s, U64 OCCUPIED) {
   // look up the attack set in the table:
   return BISHOP_TABLE[s][key];
 }
+#endif
 
 // reverse_bits(n): reverses the bits of a U64
 U64 reverse_bits(U64 n) {
@@ -1723,16 +1596,16 @@ U64 reverse_bits(U64 n) {
 // occ = bitboard of occupied pieces, s = index of slider piece, and
 // blockers = bitboard of pieces we can't capture
 inline static U64 xray_rook(U64 occ, U64 blockers, char s) {
-  U64 attacks = line_moves(s, occ);
+  U64 attacks = line_moves_magic(s, occ);
   blockers &= attacks;
-  return attacks ^ line_moves(s, occ ^ blockers);
+  return attacks ^ line_moves_magic(s, occ ^ blockers);
 }
 
 // xrayBishop(): returns bitboard of x-ray bishop attacks.
 // occ = bitboard of occupied pieces, s = index of slider piece, and
 // blockers = bitboard of pieces we can't capture
 inline static U64 xray_bishop(U64 occ, U64 blockers, char s) {
-  U64 attacks = diag_moves(s, occ);
+  U64 attacks = diag_moves_magic(s, occ);
   blockers &= attacks;
-  return attacks ^ diag_moves(s, occ ^ blockers);
+  return attacks ^ diag_moves_magic(s, occ ^ blockers);
 }
@@ -4,26 +4,69 @@
 #include <algorithm>
 #include <assert.h>
 #include <cstring>
+#include <vector>
 
 #include "consts.h"
 #include "defs.h"
 #include "eval_params.h"
+#include "nnue.h"
+#include "profile.h"
 
+// undo_info: everything make_move() overwrites that undo_move() can't cheaply
+// recompute. (the captured piece and the previous castle rights are part of
+// the move int.) hash is also used for repetition detection:
+struct undo_info {
+  int move;
+  U64 hash;
+  U64 pawn_hash;
+  U64 material_key;
+  int base_score;
+  int game_phase_score;
+  int fifty_move_counter;
+};
+
+/* attack_info: the attack maps of one position. update_move_info_bitboards()
+ * computes them once per node and caches them by ply, so the search and the
+ * move picker can refresh the move info bitboards after every move they make
+ * and undo without walking all the enemy pieces again. an entry is valid while
+ * its key is the board's hash:
+*/
+struct attack_info {
+  U64 key;
+  U64 attacks[12]; // squares attacked by each piece type (see board::attacks())
+  U64 unsafe; // all squares attacked by the side not to move
+  U64 checkers; // pieces giving check to the side to move
+  U64 pinned[2]; // pieces pinned to their own king ([0] = white's, [1] = black's)
+  U64 pinners[2]; // the sliders pinning them
+  bool complete; // are the side to move's attacks filled in, too?
+};
+
+/* board: a position and the stacks make_move() pushes onto. the struct itself
+ * is about 300 bytes (bitboards, the mailbox and the move info bitboards), and
+ * the history, accumulator and attack stacks live on the heap, so copying a
+ * board copies those stacks too. that's fine because boards are only copied
+ * per search (the root into each search thread), per position command and per
+ * bench position, never per node: the search makes and undoes moves on its
+ * own thread's board, which only touches the top of the stacks. assigning to
+ * an existing board (like search_thread::reset() does) also reuses the stacks'
+ * capacity, so after the first search it doesn't allocate:
+*/
 struct board {
   // main board data:
   U64 bitboard[12];
   char piece_board[64];
-  int move_history[MAX_GAME_MOVES];
-  U64 repetition_history[MAX_GAME_MOVES];
-  int fifty_move_history[MAX_GAME_MOVES];
+  std::vector<undo_info> history; // indexed by ply, grows as needed
+  std::vector<nnue_accumulator> accumulators; // indexed by ply, only used with a network
+  std::vector<attack_info> attack_cache; // indexed by ply
   int fifty_move_counter;
   int ply;
-  int base_score_opening; // material + PST score for opening phase
-  int base_score_endgame; // material + PST score for endgame phase
+  int base_score; // material + PST score, packed S(opening, endgame)
   int game_phase_score; // for tapered evaluation
   char turn;
   char castle_rights; // bits: 0 0 0 0 K Q k q
   U64 hash;
+  U64 pawn_hash; // zobrist hash of the pawns only (for the pawn table)
+  U64 material_key; // piece counts (see MATERIAL_KEY), for the material table
 
   // data used to generate moves:
   U64 CANT_CAPTURE;
@@ -32,6 +75,9 @@ struct board {
   U64 OCCUPIED_SQUARES;
   U64 EMPTY_SQUARES;
   U64 UNSAFE;
+  U64 CHECKERS; // opponent pieces giving check
+  U64 PINNED; // our pieces pinned to our king
+  U64 CHECK_MASK; // squares non-king moves must land on (all squares if not in check)
   U64 W;
   U64 B;
 
@@ -39,19 +85,21 @@ struct board {
   board(char* FEN);
   int get_moves(int* move_list);
   int get_nonquiet_moves(int* move_list);
+  int get_captures(int* move_list);
+  int get_quiets(int* move_list);
+  int move_from_short(int short_move);
+  bool is_legal(int move);
   bool make_move(char* move);
-  bool make_move(int move);
+  void make_move(int move);
   void undo_move();
   void make_nullmove();
   void undo_nullmove();
+  U64 key_after(int move);
   void print();
 
   // move generation utility functions:
-  void add_pawn_moves(int* move_list, int& num_moves);
-  void add_diag_moves(int* move_list, int& num_moves);
-  void add_line_moves(int* move_list, int& num_moves);
-  void add_knight_moves(int* move_list, int& num_moves);
-  void add_king_moves(int* move_list, int& num_moves);
+  int pseudo_legal_move_from_short(int short_move);
+  int remove_illegal_moves(int* move_list, int num_moves);
 
   // quiescence search utility functions:
   void add_nonquiet_pawn_moves(int* move_list, int& num_moves);
@@ -60,15 +108,24 @@ struct board {
   void add_nonquiet_knight_moves(int* move_list, int& num_moves);
   void add_nonquiet_king_moves(int* move_list, int& num_moves);
 
+  // staged move generation utility functions (quiet moves only):
+  void add_quiet_pawn_moves(int* move_list, int& num_moves);
+  void add_quiet_diag_moves(int* move_list, int& num_moves);
+  void add_quiet_line_moves(int* move_list, int& num_moves);
+  void add_quiet_knight_moves(int* move_list, int& num_moves);
+  void add_quiet_king_moves(int* move_list, int& num_moves);
+
   // utility function for SEE:
   U64 get_attackers(U64 occupied, int sq);
 
   void update_move_info_bitboards();
-  void update_unsafe();
-  U64 pinned_pieces();
+  void update_attacks(attack_info& info);
+  void add_attacks(attack_info& info, int side, U64 occupied);
+  const attack_info& attacks(bool complete = false);
+  void get_pins(int side, U64& pinned, U64& pinners);
+  U64 get_checkers();
   bool is_check();
   bool is_repetition();
-  bool is_material_draw();
 };
 
 // utility functions for board class:
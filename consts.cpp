@@ -1,23 +1,26 @@
 #include "consts.h"
 
-extern void init_consts() {
-  // ----- initialize random zobrist keys: -----
-  for (int i = 0; i < 12; i++) {
-    for (int j = 0; j < 64; j++) {
-      ZOBRIST_SQUARE_KEYS[i][j] = generator();
+// init_piece_square_scores(): pack the (material-inclusive) PSTs into
+// PIECE_SQUARE_SCORE and the castling rook differences. the tuner calls this
+// after changing PIECE_SQUARE_TABLE:
+void init_piece_square_scores() {
+  for (int piece = WP; piece <= BK; piece++) {
+    for (int square = 0; square < 64; square++) {
+      PIECE_SQUARE_SCORE[piece][square] = S(
+        PIECE_SQUARE_TABLE[OPENING_PHASE][piece][square],
+        PIECE_SQUARE_TABLE[ENDGAME_PHASE][piece][square]
+      );
     }
   }
 
-  for (int i = 0; i < 16; i++) {
-    ZOBRIST_CASTLE_RIGHTS_KEYS[i] = generator();
-  }
-
-  for (int i = 0; i < 8; i++) {
-    ZOBRIST_EP_KEYS[i] = generator();
-  }
-
-  ZOBRIST_TURN_KEY = generator();
+  // now that we've initialized all PSTs, let's get the rook differences:
+  CWK_ROOK_PST_DIFFERENCE = PIECE_SQUARE_SCORE[WR][F1] - PIECE_SQUARE_SCORE[WR][H1];
+  CWQ_ROOK_PST_DIFFERENCE = PIECE_SQUARE_SCORE[WR][D1] - PIECE_SQUARE_SCORE[WR][A1];
+  CBK_ROOK_PST_DIFFERENCE = PIECE_SQUARE_SCORE[BR][F8] - PIECE_SQUARE_SCORE[BR][H8];
+  CBQ_ROOK_PST_DIFFERENCE = PIECE_SQUARE_SCORE[BR][D8] - PIECE_SQUARE_SCORE[BR][A8];
+}
 
+extern void init_consts() {
   // ----- initialize black's PSTs + add material values -----
   for (int phase = OPENING_PHASE; phase <= ENDGAME_PHASE; phase++) {
     for (int piece = BP; piece <= BK; piece++) {
@@ -35,16 +38,8 @@ extern void init_consts() {
     }
   }
 
-  // now that we've initialized all PSTs, let's get the rook differences:
-  CWK_ROOK_PST_DIFFERENCE_OPENING = PIECE_SQUARE_TABLE[OPENING_PHASE][WR][F1] - PIECE_SQUARE_TABLE[OPENING_PHASE][WR][H1];
-  CWQ_ROOK_PST_DIFFERENCE_OPENING = PIECE_SQUARE_TABLE[OPENING_PHASE][WR][D1] - PIECE_SQUARE_TABLE[OPENING_PHASE][WR][A1];
-  CBK_ROOK_PST_DIFFERENCE_OPENING = PIECE_SQUARE_TABLE[OPENING_PHASE][BR][F8] - PIECE_SQUARE_TABLE[OPENING_PHASE][BR][H8];
-  CBQ_ROOK_PST_DIFFERENCE_OPENING = PIECE_SQUARE_TABLE[OPENING_PHASE][BR][D8] - PIECE_SQUARE_TABLE[OPENING_PHASE][BR][A8];
-
-  CWK_ROOK_PST_DIFFERENCE_ENDGAME = PIECE_SQUARE_TABLE[ENDGAME_PHASE][WR][F1] - PIECE_SQUARE_TABLE[ENDGAME_PHASE][WR][H1];
-  CWQ_ROOK_PST_DIFFERENCE_ENDGAME = PIECE_SQUARE_TABLE[ENDGAME_PHASE][WR][D1] - PIECE_SQUARE_TABLE[ENDGAME_PHASE][WR][A1];
-  CBK_ROOK_PST_DIFFERENCE_ENDGAME = PIECE_SQUARE_TABLE[ENDGAME_PHASE][BR][F8] - PIECE_SQUARE_TABLE[ENDGAME_PHASE][BR][H8];
-  CBQ_ROOK_PST_DIFFERENCE_ENDGAME = PIECE_SQUARE_TABLE[ENDGAME_PHASE][BR][D8] - PIECE_SQUARE_TABLE[ENDGAME_PHASE][BR][A8];
+  // pack both phases of every PST entry into one score:
+  init_piece_square_scores();
 
   // precalculate castling rook zobrist keys:
   CWK_ROOK_ZOBRIST = ZOBRIST_SQUARE_KEYS[WR][F1] ^ ZOBRIST_SQUARE_KEYS[WR][H1];
@@ -119,25 +114,6 @@ extern void init_consts() {
   std::sort(ANTIDIAGONAL_MASKS, ANTIDIAGONAL_MASKS + 15);
   std::sort(ANTIDIAGONAL_MASKS + 7, ANTIDIAGONAL_MASKS + 15, std::greater<U64>());
 
-  // calculate the knight moves bitmasks:
-  for (int i = 0; i < 64; i++) {
-    KNIGHT_MOVES[i] = (i > 18) ? KNIGHT_SPAN << (i - 18) : KNIGHT_SPAN >> (18 - i);
-    KNIGHT_MOVES[i] &= (i % 8 < 4) ? ~FILE_GH : ~FILE_AB;
-  }
-
-  // calculate the king moves bitmasks:
-  for (int i = 0; i < 64; i++) {
-    KING_MOVES[i] = (i > 9) ? KING_SPAN << (i - 9) : KING_SPAN >> (9 - i);
-    KING_MOVES[i] &= (i % 8 < 4) ? ~FILE_GH : ~FILE_AB;
-  }
-
-  // calculate RECT_LOOKUP:
-  for (int i = 0; i < 64; i++) {
-    for (int j = 0; j < 64; j++) {
-      RECT_LOOKUP[i][j] = in_between(i, j);
-    }
-  }
-
   // calculate isolated and passed pawn bitmasks:
   for (int sq = 0; sq < 64; sq++) {
     int file = FILE_NO(sq);
@@ -170,101 +146,8 @@ extern void init_consts() {
     LMP_ARRAY[depth][1] = (2 * depth * depth) + 3;
   }
 
-  /* ---------- initialize magic bitboard-related tables: ---------- */
-  // initialize ROOK_MASKS and BISHOP_MASKS:
-  for (int i = 0; i < 64; i++) {
-    ROOK_MASKS[i] = rmask(i);
-    BISHOP_MASKS[i] = bmask(i);
-  }
-
-  // initialize the rook magic tables:
-  U64 occ;
-  int hash_index;
-  for (int sq = 0; sq < 64; sq++) {
-    for (int idx = 0; idx < (1 << ROOK_INDEX_BITS[sq]); idx++) {
-      occ = get_blockers_from_index(idx, ROOK_MASKS[sq]);
-      hash_index = (occ * ROOK_MAGICS[sq]) >> (64 - ROOK_INDEX_BITS[sq]);
-      ROOK_TABLE[sq][hash_index] = line_moves(sq, occ);
-    }
-  }
-
-  // initialize the bishop magic tables:
-  for (int sq = 0; sq < 64; sq++) {
-    for (int idx = 0; idx < (1 << BISHOP_INDEX_BITS[sq]); idx++) {
-      occ = get_blockers_from_index(idx, BISHOP_MASKS[sq]);
-      hash_index = (occ * BISHOP_MAGICS[sq]) >> (64 - BISHOP_INDEX_BITS[sq]);
-      BISHOP_TABLE[sq][hash_index] = diag_moves(sq, occ);
-    }
-  }
 }
 
-/* ---------- functions for calculating constants ---------- */
-
-// in_between(): given indices of two squares, returns 0 if there is no line
-// between them, and 1s along the line between them (in any direction) otherwise
-// (from chessprogramming.org):
-U64 in_between(int sq1, int sq2) {
-   const U64 m1   = -1L;
-   const U64 a2a7 = 0x0001010101010100L;
-   const U64 b2g7 = 0x0040201008040200L;
-   const U64 h1b7 = 0x0002040810204080L; /* Thanks Dustin, g2b7 did not work for c1-a3 */
-   U64 btwn, line, rank, file;
-
-   btwn  = (m1 << sq1) ^ (m1 << sq2);
-   file  =   (sq2 & 7) - (sq1   & 7);
-   rank  =  ((sq2 | 7) -  sq1) >> 3 ;
-   line  =      (   (file  &  7) - 1) & a2a7; /* a2a7 if same file */
-   line += 2 * ((   (rank  &  7) - 1) >> 58); /* b1g1 if same rank */
-   line += (((rank - file) & 15) - 1) & b2g7; /* b2g7 if same diagonal */
-   line += (((rank + file) & 15) - 1) & h1b7; /* h1b7 if same antidiag */
-   line *= btwn & -btwn; /* mul acts like shift by smaller square */
-   return line & btwn;   /* return the bits on that line in-between */
-}
-
-// rmask(): calculates rook mask for a given square index (from chessprogramming.org)
-U64 rmask(int sq) {
-  U64 result = 0ULL;
-  int rk = sq / 8, fl = sq % 8, r, f;
-  for (r = rk+1; r <= 6; r++) result |= (1ULL << (fl + r*8));
-  for (r = rk-1; r >= 1; r--) result |= (1ULL << (fl + r*8));
-  for (f = fl+1; f <= 6; f++) result |= (1ULL << (f + rk*8));
-  for (f = fl-1; f >= 1; f--) result |= (1ULL << (f + rk*8));
-  return result;
-}
-
-// bmask(): calculates bishop mask for a given square index (from chessprogramming.org)
-U64 bmask(int sq) {
-  U64 result = 0ULL;
-  int rk = sq / 8, fl = sq % 8, r, f;
-  for (r=rk+1, f=fl+1; r<=6 && f<=6; r++, f++) result |= (1ULL << (f + r*8));
-  for (r=rk+1, f=fl-1; r<=6 && f>=1; r++, f--) result |= (1ULL << (f + r*8));
-  for (r=rk-1, f=fl+1; r>=1 && f<=6; r--, f++) result |= (1ULL << (f + r*8));
-  for (r=rk-1, f=fl-1; r>=1 && f>=1; r--, f--) result |= (1ULL << (f + r*8));
-  return result;
-}
-
-// get_blockers_from_index(): given a magic table hash index, calculate the
-// bitboard of blocking pieces:
-U64 get_blockers_from_index(int index, U64 mask) {
-  U64 blockers = 0L;
-  int bit_idx;
-  int i = 0;
-  while (mask) {
-    bit_idx = LSB(mask);
-    if (index & (1 << i)) {
-      blockers |= (1L << bit_idx);
-    }
-    POP_LSB(mask);
-    i++;
-  }
-  return blockers;
-}
-
-// a 64-bit pseudo-random number generator (mersenne twister engine):
-std::random_device rd;
-std::mt19937_64 generator(rd());
-
-/* ---------- end of functions for calculating constants ---------- */
 
 std::unordered_map<char, int> PIECE_INDICES = {
   {'P', 0}, {'N', 1}, {'B', 2}, {'R', 3}, {'Q', 4}, {'K', 5},
@@ -273,9 +156,6 @@ std::unordered_map<char, int> PIECE_INDICES = {
 
 char* PIECE_CHARS = "PNBRQKpnbrqk ";
 
-const int OPENING_PHASE_SCORE = 6192;
-const int ENDGAME_PHASE_SCORE = 518;
-
 U64 FILES[8];
 U64 RANKS[9];
 U64 DIAGONAL_MASKS[15];
@@ -283,75 +163,6 @@ U64 ANTIDIAGONAL_MASKS[15];
 U64 FILE_AB;
 U64 FILE_GH;
 
-// MAGIC BITBOARD tables
-U64 ROOK_MASKS[64];
-U64 BISHOP_MASKS[64];
-
-const U64 ROOK_MAGICS[64] = {
-    0xa8002c000108020ULL, 0x6c00049b0002001ULL, 0x100200010090040ULL, 0x2480041000800801ULL, 0x280028004000800ULL,
-    0x900410008040022ULL, 0x280020001001080ULL, 0x2880002041000080ULL, 0xa000800080400034ULL, 0x4808020004000ULL,
-    0x2290802004801000ULL, 0x411000d00100020ULL, 0x402800800040080ULL, 0xb000401004208ULL, 0x2409000100040200ULL,
-    0x1002100004082ULL, 0x22878001e24000ULL, 0x1090810021004010ULL, 0x801030040200012ULL, 0x500808008001000ULL,
-    0xa08018014000880ULL, 0x8000808004000200ULL, 0x201008080010200ULL, 0x801020000441091ULL, 0x800080204005ULL,
-    0x1040200040100048ULL, 0x120200402082ULL, 0xd14880480100080ULL, 0x12040280080080ULL, 0x100040080020080ULL,
-    0x9020010080800200ULL, 0x813241200148449ULL, 0x491604001800080ULL, 0x100401000402001ULL, 0x4820010021001040ULL,
-    0x400402202000812ULL, 0x209009005000802ULL, 0x810800601800400ULL, 0x4301083214000150ULL, 0x204026458e001401ULL,
-    0x40204000808000ULL, 0x8001008040010020ULL, 0x8410820820420010ULL, 0x1003001000090020ULL, 0x804040008008080ULL,
-    0x12000810020004ULL, 0x1000100200040208ULL, 0x430000a044020001ULL, 0x280009023410300ULL, 0xe0100040002240ULL,
-    0x200100401700ULL, 0x2244100408008080ULL, 0x8000400801980ULL, 0x2000810040200ULL, 0x8010100228810400ULL,
-    0x2000009044210200ULL, 0x4080008040102101ULL, 0x40002080411d01ULL, 0x2005524060000901ULL, 0x502001008400422ULL,
-    0x489a000810200402ULL, 0x1004400080a13ULL, 0x4000011008020084ULL, 0x26002114058042ULL
-};
-
-const U64 BISHOP_MAGICS[64] = {
-    0x89a1121896040240ULL, 0x2004844802002010ULL, 0x2068080051921000ULL, 0x62880a0220200808ULL, 0x4042004000000ULL,
-    0x100822020200011ULL, 0xc00444222012000aULL, 0x28808801216001ULL, 0x400492088408100ULL, 0x201c401040c0084ULL,
-    0x840800910a0010ULL, 0x82080240060ULL, 0x2000840504006000ULL, 0x30010c4108405004ULL, 0x1008005410080802ULL,
-    0x8144042209100900ULL, 0x208081020014400ULL, 0x4800201208ca00ULL, 0xf18140408012008ULL, 0x1004002802102001ULL,
-    0x841000820080811ULL, 0x40200200a42008ULL, 0x800054042000ULL, 0x88010400410c9000ULL, 0x520040470104290ULL,
-    0x1004040051500081ULL, 0x2002081833080021ULL, 0x400c00c010142ULL, 0x941408200c002000ULL, 0x658810000806011ULL,
-    0x188071040440a00ULL, 0x4800404002011c00ULL, 0x104442040404200ULL, 0x511080202091021ULL, 0x4022401120400ULL,
-    0x80c0040400080120ULL, 0x8040010040820802ULL, 0x480810700020090ULL, 0x102008e00040242ULL, 0x809005202050100ULL,
-    0x8002024220104080ULL, 0x431008804142000ULL, 0x19001802081400ULL, 0x200014208040080ULL, 0x3308082008200100ULL,
-    0x41010500040c020ULL, 0x4012020c04210308ULL, 0x208220a202004080ULL, 0x111040120082000ULL, 0x6803040141280a00ULL,
-    0x2101004202410000ULL, 0x8200000041108022ULL, 0x21082088000ULL, 0x2410204010040ULL, 0x40100400809000ULL,
-    0x822088220820214ULL, 0x40808090012004ULL, 0x910224040218c9ULL, 0x402814422015008ULL, 0x90014004842410ULL,
-    0x1000042304105ULL, 0x10008830412a00ULL, 0x2520081090008908ULL, 0x40102000a0a60140ULL,
-};
-
-// number of index bits for each square's hash table:
-const int ROOK_INDEX_BITS[64] = {
-    12, 11, 11, 11, 11, 11, 11, 12,
-    11, 10, 10, 10, 10, 10, 10, 11,
-    11, 10, 10, 10, 10, 10, 10, 11,
-    11, 10, 10, 10, 10, 10, 10, 11,
-    11, 10, 10, 10, 10, 10, 10, 11,
-    11, 10, 10, 10, 10, 10, 10, 11,
-    11, 10, 10, 10, 10, 10, 10, 11,
-    12, 11, 11, 11, 11, 11, 11, 12
-};
-
-const int BISHOP_INDEX_BITS[64] = {
-    6, 5, 5, 5, 5, 5, 5, 6,
-    5, 5, 5, 5, 5, 5, 5, 5,
-    5, 5, 7, 7, 7, 7, 5, 5,
-    5, 5, 7, 9, 9, 7, 5, 5,
-    5, 5, 7, 9, 9, 7, 5, 5,
-    5, 5, 7, 7, 7, 7, 5, 5,
-    5, 5, 5, 5, 5, 5, 5, 5,
-    6, 5, 5, 5, 5, 5, 5, 6
-};
-
-// and finally, the actual magic tables for rook and bishop-like pieces:
-U64 ROOK_TABLE[64][4096];
-U64 BISHOP_TABLE[64][512];
-
-// random numbers for zobrist hashing:
-U64 ZOBRIST_SQUARE_KEYS[12][64];
-U64 ZOBRIST_CASTLE_RIGHTS_KEYS[16];
-U64 ZOBRIST_EP_KEYS[8];
-U64 ZOBRIST_TURN_KEY;
-
 const U64 DEBRUIJN = 0x03f79d71b4cb0a89L;
 const char DEBRUIJN_INDEX[64] = {
   0, 47,  1, 56, 48, 27,  2, 60,
@@ -364,14 +175,6 @@ const char DEBRUIJN_INDEX[64] = {
   13, 18,  8, 12,  7,  6,  5, 63
 };
 
-U64 KNIGHT_SPAN = 43234889994L;
-U64 KING_SPAN = 460039L;
-
-U64 KNIGHT_MOVES[64];
-U64 KING_MOVES[64];
-
-U64 RECT_LOOKUP[64][64];
-
 U64 CWK_SAFE_SPACES = (1L << 61) | (1L << 62);
 U64 CWQ_SAFE_SPACES = (1L << 58) | (1L << 59);
 U64 CBK_SAFE_SPACES = (1L << 5)| (1L << 6);
@@ -381,15 +184,10 @@ U64 CWQ_EMPTY_SPACES = (1L << 57) | (1L << 58) | (1L << 59);
 U64 CBQ_EMPTY_SPACES = (1L << 1) | (1L << 2) | (1L << 3);
 
 // constants for differences in PST values for rooks after castling:
-int CWK_ROOK_PST_DIFFERENCE_OPENING;
-int CWQ_ROOK_PST_DIFFERENCE_OPENING;
-int CBK_ROOK_PST_DIFFERENCE_OPENING;
-int CBQ_ROOK_PST_DIFFERENCE_OPENING;
-
-int CWK_ROOK_PST_DIFFERENCE_ENDGAME;
-int CWQ_ROOK_PST_DIFFERENCE_ENDGAME;
-int CBK_ROOK_PST_DIFFERENCE_ENDGAME;
-int CBQ_ROOK_PST_DIFFERENCE_ENDGAME;
+int CWK_ROOK_PST_DIFFERENCE;
+int CWQ_ROOK_PST_DIFFERENCE;
+int CBK_ROOK_PST_DIFFERENCE;
+int CBQ_ROOK_PST_DIFFERENCE;
 
 // precalculation of zobrist keys of rook positions before and after castling:
 U64 CWK_ROOK_ZOBRIST;
@@ -397,6 +195,17 @@ U64 CWQ_ROOK_ZOBRIST;
 U64 CBK_ROOK_ZOBRIST;
 U64 CBQ_ROOK_ZOBRIST;
 
+const char CASTLE_RIGHTS_MASK[64] = {
+  0xE, 0xF, 0xF, 0xF, 0xC, 0xF, 0xF, 0xD,
+  0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+  0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+  0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+  0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+  0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+  0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+  0xB, 0xF, 0xF, 0xF, 0x3, 0xF, 0xF, 0x7
+};
+
 /* -------------------- CONSTANTS FOR ENGINE EVALUATION -------------------- */
 // indexed [attacker][victim]
 int MVV_LVA_SCORE[12][13] = {
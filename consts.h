@@ -14,31 +14,22 @@
 // initializes all uninitialized constants (bitmasks, etc.)
 extern void init_consts();
 
-// returns the RECT_LOOKUP result for a single pair i, j:
-extern U64 in_between(int sq1, int sq2);
-
-// calculates rook and bishop masks to be stored in ROOK_MASKS and BISHOP_MASKS:
-extern U64 rmask(int sq);
-extern U64 bmask(int sq);
-
-// given a magic table hash index, calculate the bitboard of blocking pieces:
-extern U64 get_blockers_from_index(int index, U64 mask);
+// packs the PSTs into PIECE_SQUARE_SCORE (called by init_consts())
+extern void init_piece_square_scores();
 
 // ENGINE SETTINGS
 // extern unsigned int TT_INDEX_MASK; // mask used on hash to get table index
 
-// a 64-bit pseudo-random number generator (for hashing):
-extern std::mt19937_64 generator;
-
 // maps piece characters to their index in the board::bitboard array
 extern std::unordered_map<char, int> PIECE_INDICES;
 
 // maps board::bitboard indices to their piece character
 extern char* PIECE_CHARS;
 
-// for tapered evaluation:
-extern const int OPENING_PHASE_SCORE;
-extern const int ENDGAME_PHASE_SCORE;
+// for tapered evaluation (defined here, so that dividing by them compiles to
+// a multiplication):
+const int OPENING_PHASE_SCORE = 6192;
+const int ENDGAME_PHASE_SCORE = 518;
 
 // bitmasks for files and ranks:
 extern U64 FILES[8];
@@ -47,11 +38,23 @@ extern U64 FILE_AB;
 extern U64 FILE_GH;
 
 /*  ---------- TABLES FOR MAGIC BITBOARDS: ---------- */
+// the attack tables (and the zobrist keys) are generated at build time by
+// gen_tables.cpp, into tables.cpp, and are read-only.
+
 // masks in the line and diagonal directions for each square. used for masking
 // out irrelevant bits from blocker set:
-extern U64 ROOK_MASKS[64];
-extern U64 BISHOP_MASKS[64];
-
+extern const U64 ROOK_MASKS[64];
+extern const U64 BISHOP_MASKS[64];
+
+#ifdef USE_PEXT
+// with PEXT, a square's blocker set maps to a perfect index (no magics needed),
+// so every square's attack sets are packed one after the other into a single
+// shared table. SLIDER_TABLE_SIZE is the sum of 2^(mask bits) over all squares:
+#define SLIDER_TABLE_SIZE 107648
+extern const U64 SLIDER_TABLE[SLIDER_TABLE_SIZE];
+extern const int ROOK_OFFSETS[64];
+extern const int BISHOP_OFFSETS[64];
+#else
 // magic numbers for rooks and bishops:
 extern const U64 ROOK_MAGICS[64];
 extern const U64 BISHOP_MAGICS[64];
@@ -61,16 +64,17 @@ extern const int ROOK_INDEX_BITS[64];
 extern const int BISHOP_INDEX_BITS[64];
 
 // and finally, the actual magic tables for rook and bishop-like pieces:
-extern U64 ROOK_TABLE[64][4096];
-extern U64 BISHOP_TABLE[64][512];
+extern const U64 ROOK_TABLE[64][4096];
+extern const U64 BISHOP_TABLE[64][512];
+#endif
 
 /*  ---------- END OF MAGIC BITBOARD-RELATED CONSTANTS ---------- */
 
-// random numbers for zobrist hashing:
-extern U64 ZOBRIST_SQUARE_KEYS[12][64];
-extern U64 ZOBRIST_CASTLE_RIGHTS_KEYS[16];
-extern U64 ZOBRIST_EP_KEYS[8];
-extern U64 ZOBRIST_TURN_KEY;
+// random numbers for zobrist hashing (from a fixed seed):
+extern const U64 ZOBRIST_SQUARE_KEYS[12][64];
+extern const U64 ZOBRIST_CASTLE_RIGHTS_KEYS[16];
+extern const U64 ZOBRIST_EP_KEYS[8];
+extern const U64 ZOBRIST_TURN_KEY;
 
 // bitmasks for bitscanning:
 extern const U64 DEBRUIJN;
@@ -80,20 +84,20 @@ extern const char DEBRUIJN_INDEX[64];
 extern U64 DIAGONAL_MASKS[15];
 extern U64 ANTIDIAGONAL_MASKS[15];
 
-// knight-span and king-span bitmasks:
-extern U64 KNIGHT_SPAN;
-extern U64 KING_SPAN;
-
 // knight-span and king-span bitmasks for the entire board
 // (i.e., KNIGHT_MOVES[x] gives a bitmask of all knight attacks for a knight on
 // square x)
-extern U64 KNIGHT_MOVES[64];
-extern U64 KING_MOVES[64];
+extern const U64 KNIGHT_MOVES[64];
+extern const U64 KING_MOVES[64];
 
 // rectangular lookup matrix: initialized as empty for any 2 squares i, j that
 // are not on the same line, and with 1s on the line in-between squares i, j
 // otherwise
-extern U64 RECT_LOOKUP[64][64];
+extern const U64 RECT_LOOKUP[64][64];
+
+// line lookup matrix: for any 2 squares i, j on the same line, the whole line
+// (edge to edge) going through them. empty otherwise
+extern const U64 LINE_LOOKUP[64][64];
 
 // bitmasks for spaces between kings and rooks (to check for possible castling)
 // the queenside pieces need a special EMPTY_SPACES mask to also include the
@@ -111,15 +115,11 @@ extern U64 CBQ_EMPTY_SPACES;
 // slightly optimize updating the base_score with rooks (so instead of doing
 // base_score -= PST[ROOK][OLD POSITION] and then
 // base_score += PST[ROOK][NEW POSITION]), we just precalculate the sum.
-extern int CWK_ROOK_PST_DIFFERENCE_OPENING;
-extern int CWQ_ROOK_PST_DIFFERENCE_OPENING;
-extern int CBK_ROOK_PST_DIFFERENCE_OPENING;
-extern int CBQ_ROOK_PST_DIFFERENCE_OPENING;
-
-extern int CWK_ROOK_PST_DIFFERENCE_ENDGAME;
-extern int CWQ_ROOK_PST_DIFFERENCE_ENDGAME;
-extern int CBK_ROOK_PST_DIFFERENCE_ENDGAME;
-extern int CBQ_ROOK_PST_DIFFERENCE_ENDGAME;
+// (these are packed scores):
+extern int CWK_ROOK_PST_DIFFERENCE;
+extern int CWQ_ROOK_PST_DIFFERENCE;
+extern int CBK_ROOK_PST_DIFFERENCE;
+extern int CBQ_ROOK_PST_DIFFERENCE;
 
 // precalculation of zobrist keys of rook positions before and after castling:
 extern U64 CWK_ROOK_ZOBRIST;
@@ -127,6 +127,11 @@ extern U64 CWQ_ROOK_ZOBRIST;
 extern U64 CBK_ROOK_ZOBRIST;
 extern U64 CBQ_ROOK_ZOBRIST;
 
+// castle rights that survive a move from or to each square (i.e., a move
+// touching E1 clears both white castle rights, a move touching H8 clears
+// black's kingside castle right, etc.):
+extern const char CASTLE_RIGHTS_MASK[64];
+
 /* -------------------- CONSTANTS FOR ENGINE EVALUATION -------------------- */
 extern int MVV_LVA_SCORE[12][13]; // contains MVV/LVA precalculated scores
 
@@ -12,6 +12,8 @@ typedef uint64_t U64;
 #define MAX_POSITION_MOVES 219
 #define MAX_GAME_MOVES 512
 #define DEFAULT_TT_SIZE 32 // in MB
+#define MAX_TT_SIZE 262144 // in MB (2^32 buckets, all that TT.index() can reach)
+#define MAX_THREADS 256
 #define DEFAULT_UCI_INPUT_BUFFER_SIZE 4096
 
 #define MATE_IN_MAX 999970 // INF - 30
@@ -71,6 +73,19 @@ enum {INIT_WK = 0x1000000000000000L, INIT_BK = 0x10L};
 // number of set bits in the bitboard:
 #define POPCOUNT(x) (__builtin_popcountll(x))
 
+// packed scores hold an opening and an endgame value in one int (the endgame
+// value in the upper 16 bits), so both phases are added up in one go. the
+// unpacking macros undo the borrow a negative opening value takes from the
+// endgame half:
+#define S(opening, endgame) ((int) ((unsigned int) (endgame) << 16) + (opening))
+#define OPENING_SCORE(s) ((int) (int16_t) (uint16_t) (unsigned int) (s))
+#define ENDGAME_SCORE(s) ((int) (int16_t) (uint16_t) ((unsigned int) ((s) + 0x8000) >> 16))
+
+// the material key packs the number of pieces of each type into 4 bits each
+// (even with every pawn promoted, no side can have more than 10 of a piece):
+#define MATERIAL_KEY(piece) (1ULL << (4 * (piece)))
+#define MATERIAL_COUNT(key, piece) (((key) >> (4 * (piece))) & 0xF)
+
 // macros for getting information out of a move integer:
 #define MOVE_TO(move) ((move >> 26) & 0x3F)
 #define MOVE_FROM(move) ((move >> 20) & 0x3F)
@@ -83,6 +98,12 @@ enum {INIT_WK = 0x1000000000000000L, INIT_BK = 0x10L};
 #define MOVE_PIECEMOVED(move) (move & 0xF)
 #define MOVE_PCR(move) ((move >> 4) & 0xF)
 
+// short (16-bit) version of a move, as stored in the transposition table:
+// FROM-square (6 bits), TO-square (6 bits), promotion piece type (3 bits).
+// NULL stays NULL, and no real move has a short move of 0:
+#define MOVE_SHORT(move) (MOVE_FROM(move) | (MOVE_TO(move) << 6) | \
+                          (PIECE_TYPE(MOVE_PROMOTION_PIECE(move)) << 12))
+
 // macros for determining castle rights:
 // CWK = castle white kingside, CBQ = castle black queenside, etc.
 #define CAN_CWK(castle_rights) (castle_rights & 0x8)
@@ -2,15 +2,73 @@
 // move scoring/ordering, etc.
 #include "engine.h"
 
-// search(): the main search algorithm (with iterative deepening)
-void search(int depth) {
-  // after this search, increment the transposition table's age:
-  TT.age++;
-
-  // zero counter of nodes searched, score-PV flag, and time control flag:
-  nodes_evaluated = 0;
-  score_pv = false;
-  stop_search = false;
+// lazy SMP depth staggering (from stockfish): helper thread i skips the
+// iterations for which ((depth + SKIP_PHASE[i]) / SKIP_SIZE[i]) is odd, so
+// the helpers spread out over different depths instead of all searching the
+// same tree in lockstep with the main thread:
+static const int SKIP_SIZE[20]  = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+static const int SKIP_PHASE[20] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+// positions searched by the 'bench' command:
+const char* BENCH_FENS[] = {
+  FEN_START,
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+  "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+  "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+  "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+  "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+  "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+  "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+  "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+  "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+  "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+  "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+  "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+  "8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1",
+  "5k2/7R/4P2p/5K2/p1r2P1p/8/8/8 b - - 0 1",
+  "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+  "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+  "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+  "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+  "3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+  "2K5/p7/7P/5pR1/8/5k2/r7/8 w - - 0 1",
+  "8/6pk/1p6/8/PP3p1p/5P2/4KP1q/3Q4 w - - 0 1",
+  "7k/3p2pp/4q3/8/4Q3/5Kp1/P6b/8 w - - 0 1",
+  "8/2p5/8/2kPKp1p/2p4P/2P5/3P4/8 w - - 0 1",
+  "8/1p3pp1/7p/5P1P/2k3P1/8/2K2P2/8 w - - 0 1",
+  "8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+  "8/3p4/p1bk3p/Pp6/1Kp1PpPp/2P2P1P/2P5/5B2 b - - 0 1",
+  "6k1/6p1/P6p/r1N5/5p2/7P/1b3PP1/4R1K1 w - - 0 1",
+  "1r3k2/4q3/2Pp3b/3Bp3/2Q2p2/1p1P2P1/1P2KP2/3N4 w - - 0 1",
+  "6k1/4pp1p/3p2p1/P1pPb3/R7/1r2P1PP/3B1P2/6K1 w - - 0 1",
+  "8/3p3B/5p2/5P2/p7/PP5b/k7/6K1 w - - 0 1",
+  "5rk1/q6p/2p3bR/1pPp1rP1/1P1Pp3/P3B1Q1/1K3P2/R7 w - - 93 90",
+  "4rrk1/1p1nq3/p7/2p1P1pp/3P2bp/3Q1Bn1/PPPB4/1K2R1NR w - - 40 21",
+  "r3k2r/3nnpbp/q2pp1p1/p7/Pp1PPPP1/4BNN1/1P5P/R2Q1RK1 w kq - 0 16",
+  "3Qb1k1/1r2ppb1/pN1n2q1/Pp1Pp1Pr/4P2p/4BP2/4B1R1/1R5K b - - 11 40",
+  "8/8/8/5N2/8/p7/8/2NK3k w - - 0 1",
+  "8/8/1P6/5pr1/8/4R3/7k/2K5 w - - 0 1",
+  "8/2p4P/8/kr6/6R1/8/8/1K6 w - - 0 1",
+  "8/R7/2q5/8/6k1/8/1P5p/K6R w - - 0 124"
+};
+
+const int NUM_BENCH_FENS = sizeof(BENCH_FENS) / sizeof(BENCH_FENS[0]);
+
+search_thread::search_thread(int id) : id(id), b(FEN_START), nodes(0) {}
+
+// reset(): load the root position and clear all per-search tables:
+void search_thread::reset(board& root) {
+  b = root;
+
+  // zero counter of nodes searched and PV flag:
+  nodes.store(0, std::memory_order_relaxed);
+  follow_pv = false;
+
+  // zero the search statistics (the eval cache itself is kept, since static
+  // evaluations don't go stale):
+  stats.clear();
+  memset(profile, 0, sizeof(profile_counter) * NUM_PROFILE_SECTIONS);
 
   // zero pv, killer move, history, and static eval tables:
   memset(pv_table, 0, sizeof(int) * MAX_SEARCH_PLY * MAX_SEARCH_PLY);
@@ -18,12 +76,247 @@ void search(int depth) {
   memset(killer_moves, 0, sizeof(int) * 2 * MAX_SEARCH_PLY);
   memset(history_moves, 0, sizeof(int) * 12 * 64);
   memset(static_evals, 0, sizeof(int) * MAX_SEARCH_PLY);
+}
+
+// search(): the main search algorithm. runs iterative deepening on the main
+// thread while the helper threads (if any) fill the shared TT in parallel
+void search(int depth) {
+  // after this search, increment the transposition table's age:
+  TT.age++;
+
+  // zero time control flag:
+  stop_search = false;
+
+  // make sure we have exactly num_threads searchers:
+  while (search_threads.size() < num_threads) {
+    search_threads.push_back(new search_thread(search_threads.size()));
+  }
+  while (search_threads.size() > num_threads) {
+    delete search_threads.back();
+    search_threads.pop_back();
+  }
+
+  // give every thread its own copy of the root position:
+  for (int i = 0; i < num_threads; i++) search_threads[i]->reset(b);
+
+  // start the helpers, then search on this thread:
+#ifdef HOT_PROFILE
+  U64 search_start = profile_clock();
+#endif
+  std::vector<std::thread> helpers;
+  for (int i = 1; i < num_threads; i++) {
+    helpers.push_back(std::thread(&search_thread::iterative_deepening, search_threads[i], depth));
+  }
+  search_threads[0]->iterative_deepening(depth);
+
+  // the main thread is done, so stop the helpers and wait for them:
+  stop_search = true;
+  for (int i = 0; i < helpers.size(); i++) helpers[i].join();
+
+#ifdef HOT_PROFILE
+  profile_counter counters[NUM_PROFILE_SECTIONS];
+  total_profile(counters);
+  print_profile(counters, (profile_clock() - search_start) * num_threads);
+#endif
+
+  // print the best move found:
+  printf("bestmove ");
+  print_move(search_threads[0]->pv_table[0][0]);
+  printf("\n");
+}
+
+// bench(): search every bench position to the given depth (from an empty TT),
+// with the given number of threads and hash size, and report the total number
+// of nodes searched (with one thread, a signature of the search) and the speed.
+// the previous Threads and Hash settings are restored afterwards:
+void bench(int depth, int threads, int hash_mb, bool json) {
+  board root = b;
+  int num_positions = NUM_BENCH_FENS;
+  U64 nodes_searched = 0;
+  search_stats bench_stats;
+  bench_stats.clear();
+#ifdef HOT_PROFILE
+  profile_counter bench_profile[NUM_PROFILE_SECTIONS] = {};
+  U64 bench_cycles = 0;
+#endif
+  int elapsed = 0;
+
+  int previous_threads = num_threads;
+  U64 previous_hash_mb = TT.size >> 20;
+  num_threads = threads;
+  if (hash_mb != previous_hash_mb) TT.resize(hash_mb);
+
+  TT.clear();
+  time_set = false;
+  quit_flag = false;
+  for (int i = 0; i < num_positions; i++) {
+    printf("\nposition %d/%d: %s\n", i + 1, num_positions, BENCH_FENS[i]);
+    b = board((char*) BENCH_FENS[i]);
+    start_time = get_time();
+#ifdef HOT_PROFILE
+    U64 search_start = profile_clock();
+#endif
+    search(depth);
+    elapsed += get_time() - start_time;
+    nodes_searched += total_nodes();
+    bench_stats.add(total_stats());
+#ifdef HOT_PROFILE
+    bench_cycles += (profile_clock() - search_start) * num_threads;
+    profile_counter counters[NUM_PROFILE_SECTIONS];
+    total_profile(counters);
+    for (int j = 0; j < NUM_PROFILE_SECTIONS; j++) {
+      bench_profile[j].cycles += counters[j].cycles;
+      bench_profile[j].calls += counters[j].calls;
+    }
+#endif
+
+    // a 'stop' or 'quit' stops the whole bench:
+    if (quit_flag) break;
+  }
+
+  U64 nps = (nodes_searched * 1000) / std::max(elapsed, 1);
+  printf("\n===========================\n");
+  printf("Depth           : %d\n", depth);
+  printf("Hash (MB)       : %llu\n", TT.size >> 20);
+  printf("Threads         : %d\n", num_threads);
+  printf("Total time (ms) : %d\n", elapsed);
+  printf("Nodes searched  : %llu\n", nodes_searched);
+  printf("Nodes/second    : %llu\n", nps);
+#ifdef SEARCH_STATS
+  bench_stats.print(nodes_searched);
+#endif
+#ifdef HOT_PROFILE
+  print_profile(bench_profile, bench_cycles);
+#endif
+
+  // the same on one line, for scripts:
+  if (json) {
+    printf("{\"depth\": %d, \"threads\": %d, \"hash_mb\": %llu, \"positions\": %d, "
+           "\"nodes\": %llu, \"time_ms\": %d, \"nps\": %llu}\n",
+           depth, num_threads, TT.size >> 20, num_positions, nodes_searched, elapsed, nps);
+  }
+
+  num_threads = previous_threads;
+  if (hash_mb != previous_hash_mb) TT.resize(previous_hash_mb);
+  b = root;
+}
+
+// total_nodes(): sum of nodes searched by all threads in the current search:
+U64 total_nodes() {
+  U64 sum = 0;
+  for (int i = 0; i < search_threads.size(); i++) sum += search_threads[i]->nodes.load(std::memory_order_relaxed);
+  return sum;
+}
+
+// total_stats(): sum of all threads' search statistics in the current search:
+search_stats total_stats() {
+  search_stats sum;
+  sum.clear();
+  for (int i = 0; i < search_threads.size(); i++) sum.add(search_threads[i]->stats);
+  return sum;
+}
+
+// print_stats(): print the search statistics of the last search:
+void print_stats() {
+#ifdef SEARCH_STATS
+  total_stats().print(total_nodes());
+#else
+  printf("info string stats are only counted in 'make STATS=1' builds\n");
+#endif
+}
+
+// add(): add another thread's counters to these (every counter is a U64):
+void search_stats::add(const search_stats& other) {
+  U64* counters = (U64*) this;
+  const U64* other_counters = (const U64*) &other;
+  for (int i = 0; i < sizeof(search_stats) / sizeof(U64); i++) counters[i] += other_counters[i];
+}
+
+// percent(): part as a percentage of total (0 if total is 0):
+static double percent(U64 part, U64 total) {
+  return total ? 100.0 * part / total : 0;
+}
+
+// print(): print the counters as 'info string stats' lines:
+void search_stats::print(U64 nodes) {
+  printf("info string stats tt probes %llu hits %.1f%% cutoffs %.1f%%\n",
+         tt_probes, percent(tt_hits, tt_probes), percent(tt_cutoffs, tt_probes));
+  printf("info string stats beta cutoffs %llu first move %.1f%%\n",
+         beta_cutoffs, percent(first_move_cutoffs, beta_cutoffs));
+  printf("info string stats null move tries %llu cutoffs %.1f%%\n",
+         null_move_tries, percent(null_move_cutoffs, null_move_tries));
+  printf("info string stats pruned rfp %llu razoring %llu futility %llu\n",
+         rfp_prunes, razor_prunes, futility_prunes);
+  printf("info string stats lmr searches %llu re-searches %.1f%%\n",
+         lmr_searches, percent(lmr_researches, lmr_searches));
+  printf("info string stats eval lookups %llu tt hits %.1f%% cache hits %.1f%%\n",
+         eval_lookups, percent(eval_tt_hits, eval_lookups), percent(eval_cache_hits, eval_lookups));
+  printf("info string stats qsearch nodes %.1f%% tb hits %llu\n",
+         percent(qsearch_nodes, nodes), tb_hits);
+
+  // the branching factor at each ply: nodes at the next ply per node at this one:
+  printf("info string stats branching");
+  for (int ply = 0; ply < MAX_SEARCH_PLY && ply_nodes[ply + 1]; ply++) {
+    printf(" %.2f", (double) ply_nodes[ply + 1] / ply_nodes[ply]);
+  }
+  printf("\n");
+}
+
+// total_profile(): sum of all threads' profile counters in the current search:
+void total_profile(profile_counter* sum) {
+  memset(sum, 0, sizeof(profile_counter) * NUM_PROFILE_SECTIONS);
+  for (int i = 0; i < search_threads.size(); i++) {
+    for (int j = 0; j < NUM_PROFILE_SECTIONS; j++) {
+      sum[j].cycles += search_threads[i]->profile[j].cycles;
+      sum[j].calls += search_threads[i]->profile[j].calls;
+    }
+  }
+}
+
+// print_profile(): print the profile table as 'info string profile' lines. the
+// sections nest, so their shares can add up to more than 100%:
+void print_profile(const profile_counter* counters, U64 total_cycles) {
+  printf("info string profile %-12s %12s %14s %10s %7s\n", "section", "calls", "cycles", "per call", "share");
+  for (int i = 0; i < NUM_PROFILE_SECTIONS; i++) {
+    const profile_counter& c = counters[i];
+    printf("info string profile %-12s %12llu %14llu %10.1f %6.1f%%\n", profile_section_name(i),
+           c.calls, c.cycles, (double) c.cycles / std::max(c.calls, (U64) 1),
+           percent(c.cycles, total_cycles));
+  }
+}
+
+// static_eval(): the static evaluation of the current position, taken from
+// the TT entry (tt_eval) if there is one, else from the eval cache:
+int search_thread::static_eval(int tt_eval) {
+  STAT(eval_lookups);
+  if (tt_eval != NO_SCORE) {
+    STAT(eval_tt_hits);
+    return tt_eval;
+  }
+#ifdef SEARCH_STATS
+  if (evals.contains(b.hash)) STAT(eval_cache_hits);
+#endif
+  return evals.probe(b, &pawns, &materials);
+}
+
+// iterative_deepening(): the main search loop of a single thread
+void search_thread::iterative_deepening(int depth) {
+#ifdef HOT_PROFILE
+  // count this thread's hot path cycles in its own counters:
+  thread_profile() = profile;
+#endif
 
   // find best move in this position
   int alpha = -INF;
   int beta = INF;
   // int aspiration_delta = ASPIRATION_WINDOW_VALUE;
   for (int cur_depth = 1; cur_depth <= depth; cur_depth++) {
+    // helpers skip some depths so that they don't all search the same tree:
+    if (id) {
+      int i = (id - 1) % 20;
+      if (((cur_depth + SKIP_PHASE[i]) / SKIP_SIZE[i]) % 2) continue;
+    }
+
     // enable the follow_pv flag:
     follow_pv = true;
 
@@ -33,15 +326,25 @@ void search(int depth) {
     // if we have to stop, stop the search:
     if (stop_search) break;
 
-    // print info to console:
-    printf("info score cp %d depth %d nodes %d time %d pv ",
-      score, cur_depth, nodes_evaluated, get_time() - start_time
+    // only the main thread reports to the GUI:
+    if (id) continue;
+
+    // print info to console (nodes and nps are summed over all threads):
+    int elapsed = get_time() - start_time;
+    U64 nodes_searched = total_nodes();
+    printf("info score cp %d depth %d nodes %llu nps %llu time %d pv ",
+      score, cur_depth, nodes_searched, (nodes_searched * 1000) / std::max(elapsed, 1), elapsed
     );
     for (int i = 0; i < pv_length[0]; i++) {
       print_move(pv_table[0][i]);
       printf(" ");
     }
     printf("\n");
+#ifdef SEARCH_STATS
+    // (only this thread's counters: the helpers are still writing theirs, so
+    // they're only summed after the search, by 'stats' and 'bench'):
+    stats.print(nodes.load(std::memory_order_relaxed));
+#endif
 
     // if searching up to this ply took > 1/2 of our allocated time, terminate prematurely:
     // if ((time_limit != -1) && ((get_time() - start_time) > (time_limit / 2))) break;
@@ -65,21 +368,22 @@ void search(int depth) {
     // and the best move is in pv_table[0][0]
   }
 
-  // print the best move found:
-  printf("bestmove ");
-  print_move(pv_table[0][0]);
-  printf("\n");
+#ifdef HOT_PROFILE
+  thread_profile() = NULL;
+#endif
 }
 
 // negamax(): the main tree-search function
-int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune) {
-  // every 2048 nodes, communicate with the GUI / check time:
-  if ((nodes_evaluated & 2047) == 0) communicate();
+int search_thread::negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune) {
+  // every 2048 nodes, the main thread communicates with the GUI / checks time:
+  U64 node_count = nodes.load(std::memory_order_relaxed);
+  if (!id && (node_count & 2047) == 0) communicate();
   if (stop_search) return 0;
-  nodes_evaluated++;
+  nodes.store(node_count + 1, std::memory_order_relaxed);
+  STAT(ply_nodes[forward_ply]);
 
   // if this is a draw, return 0:
-  if (b.is_repetition() || b.is_material_draw() || b.fifty_move_counter >= 100) return 0;
+  if (b.is_repetition() || materials.probe(b)->is_draw || b.fifty_move_counter >= 100) return 0;
 
   pv_length[forward_ply] = forward_ply;
   bool pv = (beta - alpha != 1);
@@ -96,9 +400,15 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
     if (alpha >= beta) return alpha;
   } */
 
-  // look up the position in the TT:
-  score = TT.probe(depth, alpha, beta);
-  if (b.ply > 0 && !pv && (score != TT_NO_MATCH)) return score;
+  // look up the position in the TT (which also remembers its static eval):
+  int tt_eval;
+  score = TT.probe(b.hash, depth, alpha, beta, &tt_eval);
+  STAT(tt_probes);
+  if (tt_eval != NO_SCORE) STAT(tt_hits);
+  if (b.ply > 0 && !pv && (score != TT_NO_MATCH)) {
+    STAT(tt_cutoffs);
+    return score;
+  }
   score = -INF;
 
   // EGTB lookup: make sure neither side can castle
@@ -124,7 +434,8 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
       0, 0, 0, true
     );
     if (wdl != TB_RESULT_FAILED) {
-      TT.put(depth, TB_VALUES[wdl], 0, TT_EXACT, false);
+      STAT(tb_hits);
+      TT.put(b.hash, depth, TB_VALUES[wdl], NO_SCORE, 0, TT_EXACT, false);
       return TB_VALUES[wdl];
     }
 	}
@@ -137,7 +448,7 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
   if (depth <= 0 && !is_check) return quiescence(alpha, beta, forward_ply);
 
   // store static eval in static eval table:
-  int eval = evaluate();
+  int eval = static_eval(tt_eval);
   static_evals[forward_ply] = eval;
   bool improving = (!is_check && forward_ply >= 2 && eval > static_evals[forward_ply-2]);
 
@@ -170,13 +481,18 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
     int pessimistic_eval = eval - (75 * depth) - (100 * improving);
     if (depth < 3 &&
         pessimistic_eval >= beta
-    ) return pessimistic_eval;
+    ) {
+      STAT(rfp_prunes);
+      return pessimistic_eval;
+    }
 
     // null-move pruning:
     if (depth >= NULL_MOVE_PRUNING_DEPTH &&
-        b.move_history[b.ply-1] != NULL
+        b.history[b.ply-1].move != NULL
     ) {
       // give current side an extra turn:
+      STAT(null_move_tries);
+      TT.prefetch(b.hash ^ ZOBRIST_TURN_KEY);
       b.make_nullmove();
 
       // search the position with a reduced depth:
@@ -189,16 +505,24 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
       if (stop_search) return 0;
 
       // fail-hard beta cutoff:
-      if (null_move_score >= beta) return beta;
+      if (null_move_score >= beta) {
+        STAT(null_move_cutoffs);
+        return beta;
+      }
 
-      // otherwise, we failed null-move pruning:
+      // otherwise, we failed null-move pruning. the null move search left the
+      // move info bitboards for the other side, so we restore them:
       failed_null = true;
+      b.update_move_info_bitboards();
     }
 
     // razoring:
     if (depth == 1 &&
         eval + 200 < beta
-    )  return quiescence(alpha, beta, forward_ply);
+    ) {
+      STAT(razor_prunes);
+      return quiescence(alpha, beta, forward_ply);
+    }
 
     /* if (depth < 3 &&
         eval + (200 * depth) < alpha
@@ -207,34 +531,22 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
 
   /* ---------- END OF FORWARD PRUNING ---------- */
 
-  // generate all possible moves from this position:
-  int moves[MAX_POSITION_MOVES];
-  int num_moves = b.get_moves(moves);
-
-  // set the best move to be the first move on the list, just so we don't return a NULL-move
-  // in case no move raises alpha:
-  if (num_moves) best_move = moves[0];
+  // the TT move is tried first (if it's legal in this position):
+  int tt_move = b.move_from_short(TT.best_move(b.hash));
 
-  // if we're following the principal variation, enable PV scoring:
+  // if we're following the principal variation, try the PV move first instead:
   if (follow_pv) {
     follow_pv = false;
-    for (int i = 0; i < num_moves; i++) {
-      if (pv_table[0][forward_ply] == moves[i]) {
-        score_pv = true;
-        follow_pv = true;
-        break;
-      }
+    int pv_move = pv_table[0][forward_ply];
+    if (pv_move && b.move_from_short(MOVE_SHORT(pv_move)) == pv_move) {
+      tt_move = pv_move;
+      follow_pv = true;
     }
   }
 
-  // score the moves:
-  int move_scores[MAX_POSITION_MOVES];
-  for (int i = 0; i < num_moves; i++) {
-    move_scores[i] = score_move(moves[i], forward_ply);
-  }
-
-  // variables for move selection (selection sort, in main recursive loops):
-  int move, move_index;
+  // the moves are generated in stages, as we need them:
+  move_picker picker(*this, tt_move, forward_ply, false);
+  int move;
 
   // recursively find the best move from here:
   int non_pruned_moves = 0;
@@ -245,26 +557,13 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
   bool skip_quiets = false;
   int extension;
   int R;
-  for (int i = 0; i < num_moves; i++) {
-    // selection sort to find the best move:
-    move_index = 0; // contains the index of the best move
-    for (int j = 0; j < num_moves; j++) {
-      if (move_scores[j] > move_scores[move_index]) {
-        move_index = j;
-      }
-    }
-
-    // once we find the move with the highest score, set its score to -INF so it
-    // can't be selected again (essentially marking it as 'seen')
-    move = moves[move_index];
-    move_scores[move_index] = -INF;
-
+  while ((move = picker.next_move())) {
     // figure out some things about this move:
     tactical = (MOVE_CAPTURED(move) != NONE) || (MOVE_IS_PROMOTION(move));
     is_killer = (move == killer_moves[0][forward_ply]) ||
                 (move == killer_moves[1][forward_ply]);
     recapture = (b.ply) &&
-                (MOVE_CAPTURED(b.move_history[b.ply-1]) != NONE) &&
+                (MOVE_CAPTURED(b.history[b.ply-1].move) != NONE) &&
                 (MOVE_CAPTURED(move) != NONE);
 
     // ----- move skipping: ----- //
@@ -282,7 +581,10 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
       if (depth < 4 &&
           !tactical &&
           eval + (150 * depth) - (100 * improving) <= alpha
-      ) continue;
+      ) {
+        STAT(futility_prunes);
+        continue;
+      }
     }
 
     // skip quiet moves if this move is quiet and skip_quiets flag is on:
@@ -290,9 +592,12 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
 
     // ----- end of move skipping ----- //
 
+    // make the move:
+    TT.prefetch(b.key_after(move));
+    b.make_move(move);
+
     non_pruned_moves++;
     // if (!tactical) num_quiets++;
-    b.make_move(move);
 
     // extensions:
     /* extension = 0;
@@ -319,7 +624,7 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
     R = 1;
     if (depth > 2 && non_pruned_moves > 2) {
       if (!tactical) {
-        if (!b.is_check() && non_pruned_moves >= LMR_FULL_DEPTH_MOVES) R += 2;
+        if (!b.get_checkers() && non_pruned_moves >= LMR_FULL_DEPTH_MOVES) R += 2;
         if (!pv) R++;
         // if (num_quiets > 3 && failed_null) R++;
         if (!improving) R++;
@@ -339,7 +644,9 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
     }
     else {
       score = -negamax(depth - R, -alpha - 1, -alpha, forward_ply + 1, true);
+      if (R != 1) STAT(lmr_searches);
       if ((R != 1) && (score > alpha)) {
+        STAT(lmr_researches);
         score = -negamax(depth - 1, -alpha - 1, -alpha, forward_ply + 1, true);
       }
       if ((score > alpha) && (score < beta)) {
@@ -358,8 +665,11 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
       if (score > alpha) {
         // fail-hard beta cutoff (node fails high)
         if (score >= beta) {
+          STAT(beta_cutoffs);
+          if (non_pruned_moves == 1) STAT(first_move_cutoffs);
+
           // store beta in the transposition table for this position:
-          TT.put(depth, beta, move, TT_BETA, true);
+          TT.put(b.hash, depth, beta, eval, move, TT_BETA, true);
 
           // add this move to the killer move list, only if it's a quiet move
           if (move != NULL && !tactical && (move != killer_moves[0][forward_ply])) {
@@ -396,74 +706,69 @@ int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune)
     }
   }
 
-  if (num_moves == 0) return is_check ? -INF + forward_ply : 0;
+  // no legal moves (we only prune moves after searching a legal one):
+  if (non_pruned_moves == 0) return is_check ? -INF + forward_ply : 0;
 
   // node fails low. store the value in the transposition table first, then exit:
-  TT.put(depth, alpha, best_move, tt_flag, false);
+  TT.put(b.hash, depth, alpha, eval, best_move, tt_flag, false);
   return alpha;
 }
 
 // quiescence(): the quiescence search algorithm
-int quiescence(int alpha, int beta, int forward_ply) {
-  // every 2048 nodes, communicate with the GUI / check time:
-  if ((nodes_evaluated & 2047) == 0) communicate();
-  nodes_evaluated++;
+int search_thread::quiescence(int alpha, int beta, int forward_ply) {
+  // every 2048 nodes, the main thread communicates with the GUI / checks time:
+  U64 node_count = nodes.load(std::memory_order_relaxed);
+  if (!id && (node_count & 2047) == 0) communicate();
+  nodes.store(node_count + 1, std::memory_order_relaxed);
+  STAT(qsearch_nodes);
+
+  // update the move info bitboards (make_move() doesn't):
+  b.update_move_info_bitboards();
 
   // avoid stack overflow:
-  if (forward_ply >= MAX_SEARCH_PLY) return evaluate();
+  if (forward_ply >= MAX_SEARCH_PLY) return evals.probe(b, &pawns, &materials);
 
   // call negamax if we're in check, to make sure we don't get ourselves in a
   // mating net
-  b.update_move_info_bitboards();
   if (b.is_check()) return negamax(0, alpha, beta, forward_ply, false);
 
   // if this is a draw, return 0:
-  if (b.is_repetition() || b.is_material_draw() || b.fifty_move_counter >= 100) return 0;
+  if (b.is_repetition() || materials.probe(b)->is_draw || b.fifty_move_counter >= 100) return 0;
 
   // do we have this position stored in the TT? if so, use it:
-  int tt_score = TT.probe(0, alpha, beta);
-  if (b.ply > 0 && (tt_score != TT_NO_MATCH)) return tt_score;
+  int tt_eval;
+  int tt_score = TT.probe(b.hash, 0, alpha, beta, &tt_eval);
+  STAT(tt_probes);
+  if (tt_eval != NO_SCORE) STAT(tt_hits);
+  if (b.ply > 0 && (tt_score != TT_NO_MATCH)) {
+    STAT(tt_cutoffs);
+    return tt_score;
+  }
 
   // static evaluation:
-  int eval = evaluate();
+  int eval = static_eval(tt_eval);
 
   // alpha/beta escape conditions:
   if (eval >= beta) return beta;
   if (eval > alpha) alpha = eval;
 
-  // generate all possible moves from this position:
-  int moves[MAX_POSITION_MOVES];
-  int num_moves = b.get_nonquiet_moves(moves);
+  // the TT move is only tried first if it's a capture or a promotion:
+  int tt_move = b.move_from_short(TT.best_move(b.hash));
+  if (MOVE_CAPTURED(tt_move) == NONE && !MOVE_IS_PROMOTION(tt_move)) tt_move = NULL;
 
-  // score the moves:
-  int move_scores[MAX_POSITION_MOVES];
-  for (int i = 0; i < num_moves; i++) {
-    move_scores[i] = score_move(moves[i], forward_ply);
-  }
-
-  // recursively qsearch the horizon:
-  int move, move_index;
+  // recursively qsearch the horizon (the move picker only hands out captures
+  // and promotions here):
+  move_picker picker(*this, tt_move, forward_ply, true);
+  int move;
   int best_case;
   int score;
-  for (int i = 0; i < num_moves; i++) {
-    // selection sort to find the best move:
-    move_index = 0; // contains the index of the best move
-    for (int j = 0; j < num_moves; j++) {
-      if (move_scores[j] > move_scores[move_index]) {
-        move_index = j;
-      }
-    }
-
-    // once we find the move with the highest score, set its score to -INF so it
-    // can't be selected again (essentially marking it as 'seen')
-    move = moves[move_index];
-    move_scores[move_index] = -INF;
-
+  while ((move = picker.next_move())) {
     // delta pruning: could this move improve alpha, in the best case?
     // best_case = std::max(see(move), DELTA_VALUE);
     // if (eval + best_case <= alpha) continue;
 
     // make move & recursively call qsearch:
+    TT.prefetch(b.key_after(move));
     b.make_move(move);
     score = -quiescence(-beta, -alpha, forward_ply + 1);
     b.undo_move();
@@ -484,40 +789,130 @@ int quiescence(int alpha, int beta, int forward_ply) {
   return alpha;
 }
 
-// score_move(): the move scoring function
-int score_move(int move, int forward_ply) {
-  // is this a PV move?
-  if (score_pv && (move == pv_table[0][forward_ply])) {
-    score_pv = false;
-    return 10000;
-  }
+move_picker::move_picker(search_thread& thread, int tt_move, int forward_ply, bool captures_only) :
+  b(thread.b), stage(STAGE_TT_MOVE), captures_only(captures_only), tt_move(tt_move),
+  history_moves(thread.history_moves), current(0), num_captures(0), num_moves(0), num_bad_captures(0) {
+  killers[0] = captures_only ? NULL : thread.killer_moves[0][forward_ply];
+  killers[1] = captures_only ? NULL : thread.killer_moves[1][forward_ply];
+}
 
-  // is this move the best move for this position, as stored in our TT?
-  if (move == (&TT.TT[b.hash & TT.mask])->best_move) return 9000;
+// next_move(): the next move to search, or NULL if there are none left. each
+// stage falls through to the next one once it runs out of moves:
+int move_picker::next_move() {
+  int move;
+  switch (stage) {
+    case STAGE_TT_MOVE:
+      stage = STAGE_GENERATE_CAPTURES;
+      if (tt_move) return tt_move;
+
+    case STAGE_GENERATE_CAPTURES:
+      // generate captures and score them by MVV/LVA (the search made and
+      // undid the TT move, so the move info bitboards have to be updated):
+      if (tt_move) b.update_move_info_bitboards();
+      num_captures = num_moves = b.get_captures(moves);
+      {
+        PROFILE(PROFILE_SCORE_MOVES);
+        for (int i = 0; i < num_captures; i++) {
+          scores[i] = MVV_LVA_SCORE[MOVE_PIECEMOVED(moves[i])][MOVE_CAPTURED(moves[i])] +
+                      (MOVE_IS_PROMOTION(moves[i]) ? 900 : 0);
+        }
+      }
+      stage = STAGE_GOOD_CAPTURES;
+
+    case STAGE_GOOD_CAPTURES:
+      while (current < num_captures) {
+        pick_best(num_captures);
+        move = moves[current++];
+        if (move == tt_move) continue;
+
+        // save losing captures for later:
+        if (!captures_only && !see(b, move, 0)) {
+          moves[num_bad_captures++] = move;
+          continue;
+        }
 
-  // does this move give check?
-  // if (gives_check(move)) return 8000;
+        return move;
+      }
+      if (captures_only) {
+        stage = STAGE_DONE;
+        return NULL;
+      }
 
-  // is this a recapture?
-  /* if ((b.ply) &&
-      (MOVE_CAPTURED(b.move_history[b.ply-1]) != NONE) &&
-      (MOVE_CAPTURED(move) != NONE) &&
-      (MOVE_TO(b.move_history[b.ply-1]) == MOVE_TO(move))
-  ) return 8000; */
+      // killer moves are quiet moves, so make sure they're still playable and
+      // not captures in this position:
+      b.update_move_info_bitboards();
+      for (int i = 0; i < 2; i++) {
+        if (killers[i]) {
+          killers[i] = b.move_from_short(MOVE_SHORT(killers[i]));
+          if (killers[i] == tt_move ||
+              MOVE_CAPTURED(killers[i]) != NONE ||
+              MOVE_IS_PROMOTION(killers[i])
+          ) killers[i] = NULL;
+        }
+      }
+      if (killers[1] == killers[0]) killers[1] = NULL;
+      stage = STAGE_KILLER_1;
+
+    case STAGE_KILLER_1:
+      stage = STAGE_KILLER_2;
+      if (killers[0]) return killers[0];
+
+    case STAGE_KILLER_2:
+      stage = STAGE_GENERATE_QUIETS;
+      if (killers[1]) return killers[1];
+
+    case STAGE_GENERATE_QUIETS:
+      // generate quiet moves after the captures and sort them by history
+      // (insertion sort - there are only a few dozen of them):
+      if (killers[0] || killers[1]) b.update_move_info_bitboards();
+      num_moves = num_captures + b.get_quiets(moves + num_captures);
+      {
+        PROFILE(PROFILE_SCORE_MOVES);
+        for (int i = num_captures; i < num_moves; i++) {
+          move = moves[i];
+          int score = history_moves[MOVE_PIECEMOVED(move)][MOVE_TO(move)];
+          int j = i;
+          while (j > num_captures && scores[j-1] < score) {
+            moves[j] = moves[j-1];
+            scores[j] = scores[j-1];
+            j--;
+          }
+          moves[j] = move;
+          scores[j] = score;
+        }
+      }
+      current = num_captures;
+      stage = STAGE_QUIETS;
+
+    case STAGE_QUIETS:
+      while (current < num_moves) {
+        move = moves[current++];
+        if (move == tt_move || move == killers[0] || move == killers[1]) continue;
+        return move;
+      }
+      current = 0;
+      stage = STAGE_BAD_CAPTURES;
+
+    case STAGE_BAD_CAPTURES:
+      if (current < num_bad_captures) return moves[current++];
+      stage = STAGE_DONE;
 
-  // in the endgame, is this a pawn push?
-  // TODO
+    case STAGE_DONE:
+      return NULL;
+  }
 
-  // MVV/LVA scoring
-  int score = MVV_LVA_SCORE[MOVE_PIECEMOVED(move)][MOVE_CAPTURED(move)] +
-              (MOVE_IS_PROMOTION(move) ? 900 : 0);
-  if (score) return score;
-  /* if (MOVE_CAPTURED(move) != NONE) return see(move);
-  if (MOVE_IS_PROMOTION(move)) return 1000; */
+  return NULL;
+}
 
-  // killer move heuristic for quiet moves:
-  if (move == killer_moves[0][forward_ply] ||
-      move == killer_moves[1][forward_ply]) return 50;
+// pick_best(): move the best move in moves[current:end] to moves[current]
+// (one step of a selection sort):
+void move_picker::pick_best(int end) {
+  PROFILE(PROFILE_PICK_BEST);
 
-  return history_moves[MOVE_PIECEMOVED(move)][MOVE_TO(move)];
+  int best = current;
+  for (int i = current + 1; i < end; i++) {
+    if (scores[i] > scores[best]) best = i;
+  }
+  std::swap(moves[current], moves[best]);
+  std::swap(scores[current], scores[best]);
 }
@@ -5,16 +5,206 @@
 #ifndef ENGINE_H
 #define ENGINE_H
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "syzygy/tbprobe.h"
 
 #include "board.h"
 #include "eval.h"
 #include "globals.h"
+#include "profile.h"
 #include "utils.h"
 
+/* search_stats: counters of what one thread's search did, so pruning changes
+ * can be judged by their efficiency as well as by their strength. they are only
+ * counted in builds with -DSEARCH_STATS ('make STATS=1'), in other builds STAT()
+ * compiles to nothing and the counters stay 0.
+*/
+struct search_stats {
+  // TT probes, those that found an entry (with a static eval, which every entry
+  // but a root TB entry has) and those that cut the node off:
+  U64 tt_probes;
+  U64 tt_hits;
+  U64 tt_cutoffs;
+
+  // beta cutoffs in negamax(), and how many of them the first move caused:
+  U64 beta_cutoffs;
+  U64 first_move_cutoffs;
+
+  // null-move searches, and how many of them failed high:
+  U64 null_move_tries;
+  U64 null_move_cutoffs;
+
+  // nodes pruned by reverse futility pruning and razoring, and moves skipped
+  // by futility pruning:
+  U64 rfp_prunes;
+  U64 razor_prunes;
+  U64 futility_prunes;
+
+  // reduced (LMR) searches, and how many of them had to be searched again:
+  U64 lmr_searches;
+  U64 lmr_researches;
+
+  // static evaluations the search needed, and those taken from the TT and
+  // from the eval cache:
+  U64 eval_lookups;
+  U64 eval_tt_hits;
+  U64 eval_cache_hits;
+
+  // quiescence nodes (the thread's nodes count them too) and TB hits:
+  U64 qsearch_nodes;
+  U64 tb_hits;
+
+  // negamax() nodes by distance from the root:
+  U64 ply_nodes[MAX_SEARCH_PLY + 1];
+
+  void clear() { memset(this, 0, sizeof(search_stats)); }
+
+  // add(): add another thread's counters to these:
+  void add(const search_stats& other);
+
+  // print(): print the counters as 'info string stats' lines (nodes is the
+  // total number of nodes they were counted over):
+  void print(U64 nodes);
+};
+
+#ifdef SEARCH_STATS
+  #define STAT(counter) (stats.counter++)
+#else
+  #define STAT(counter)
+#endif
+
+// search_thread: everything a single searcher owns. luna uses lazy SMP: every
+// thread searches the same root position with its own board and heuristic
+// tables, and they only share the transposition table. thread 0 is the main
+// thread - it talks to the GUI, prints search info and picks the best move.
+struct search_thread {
+  // index of this thread (0 = main thread):
+  int id;
+
+  // this thread's copy of the position being searched:
+  board b;
+
+  // number of nodes this thread has searched. the main thread reads it while
+  // the helpers search (to sum the node counts), so it's atomic, but only this
+  // thread writes it, so it's counted with a relaxed load and store:
+  std::atomic<U64> nodes;
+
+  // for following the PV:
+  bool follow_pv;
+
+  // the principal variation table:
+  int pv_length[MAX_SEARCH_PLY];
+  int pv_table[MAX_SEARCH_PLY][MAX_SEARCH_PLY];
+
+  // to store killer moves and history moves:
+  int killer_moves[2][MAX_SEARCH_PLY]; // [move_id][ply]
+  int history_moves[12][64]; // [piece][square]
+
+  int static_evals[MAX_SEARCH_PLY];
+
+  // this thread's pawn structure, material and static evaluation caches:
+  pawn_table pawns;
+  material_table materials;
+  eval_table evals;
+
+  // what this thread's search did since the last reset() (see search_stats):
+  search_stats stats;
+
+  // this thread's hot path cycle counts since the last reset() (see profile.h):
+  profile_counter profile[NUM_PROFILE_SECTIONS];
+
+  search_thread(int id);
+
+  // reset(): load the root position and clear all per-search tables:
+  void reset(board& root);
+
+  // iterative_deepening(): the main search loop of a single thread:
+  void iterative_deepening(int depth);
+
+  // static_eval(): the static evaluation of the current position, taken from
+  // the TT entry (tt_eval) if there is one, else from the eval cache:
+  int static_eval(int tt_eval);
+
+  int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune);
+  int quiescence(int alpha, int beta, int forward_ply);
+};
+
+// the stages of the move picker, in the order they're played:
+enum {
+  STAGE_TT_MOVE, STAGE_GENERATE_CAPTURES, STAGE_GOOD_CAPTURES, STAGE_KILLER_1,
+  STAGE_KILLER_2, STAGE_GENERATE_QUIETS, STAGE_QUIETS, STAGE_BAD_CAPTURES, STAGE_DONE
+};
+
+/* move_picker: hands out the moves of a position one at a time, best first, and
+ * only generates moves once it runs out of better ones: first the TT move, then
+ * captures that don't lose material (by MVV/LVA), then the killer moves, then
+ * quiet moves by history score, and finally the losing captures. a cutoff on
+ * the TT move costs no move generation at all, and quiet moves are only
+ * generated if no capture or killer cuts off.
+ *
+ * all moves handed out are legal. in quiescence search, only the TT move (if
+ * it's a capture or a promotion) and the captures are played, all by MVV/LVA.
+*/
+struct move_picker {
+  board& b;
+  int stage;
+  bool captures_only;
+
+  // the moves played in the early stages (so later stages don't repeat them):
+  int tt_move;
+  int killers[2];
+
+  // the history table used to sort the quiet moves:
+  int (*history_moves)[64];
+
+  // the generated moves and their scores. losing captures are moved to the
+  // front of the list (over captures we already played) as we find them:
+  int moves[MAX_POSITION_MOVES];
+  int scores[MAX_POSITION_MOVES];
+  int current;
+  int num_captures;
+  int num_moves;
+  int num_bad_captures;
+
+  move_picker(search_thread& thread, int tt_move, int forward_ply, bool captures_only);
+
+  // next_move(): the next move to search, or NULL if there are none left:
+  int next_move();
+
+  // pick_best(): move the best move in moves[current:end] to moves[current]:
+  void pick_best(int end);
+};
+
+// search(): search the position on the global board with all threads:
 void search(int depth);
-int negamax(int depth, int alpha, int beta, int forward_ply, bool forward_prune);
-int quiescence(int alpha, int beta, int forward_ply);
-int score_move(int move, int forward_ply);
+
+// the positions searched by bench() (also the microbench corpus):
+extern const char* BENCH_FENS[];
+extern const int NUM_BENCH_FENS;
+
+// bench(): search a fixed set of positions to the given depth (with the given
+// threads and hash size) and report the total node count and speed:
+void bench(int depth, int threads, int hash_mb, bool json);
+
+// total_nodes(): sum of nodes searched by all threads in the current search:
+U64 total_nodes();
+
+// total_stats(): sum of all threads' search statistics in the current search
+// (only call it once the helpers are done, since it reads their counters):
+search_stats total_stats();
+
+// print_stats(): print the search statistics of the last search (the 'stats'
+// command):
+void print_stats();
+
+// total_profile(): sum of all threads' profile counters in the current search:
+void total_profile(profile_counter* sum);
+
+// print_profile(): print the profile table, with every section's share of the
+// given number of cycles (the search time of all threads):
+void print_profile(const profile_counter* counters, U64 total_cycles);
 
 #endif
@@ -1,82 +1,70 @@
 #include "eval.h"
 
+#ifdef EVAL_TRACE
+eval_trace* eval_trace_target = NULL;
+#endif
+
 // evaluate(): the board evaluation function
-int evaluate() {
+int evaluate(board& b, pawn_table* pawns, material_table* materials) {
+  PROFILE(PROFILE_EVALUATE);
+
+  // if we have a network, it does all the work:
+  if (nnue_network) return nnue_evaluate(b);
+
   // start with naive evaluation (b.base_score) and add bonus:
   int bonus = 0;
 
   // tempo bonus:
   bonus += TEMPO_BONUS * (b.turn == WHITE ? 1 : -1);
 
-  // bishop pair bonus:
-  if (SEVERAL(b.bitboard[WB])) bonus += BISHOP_PAIR_BONUS;
-  if (SEVERAL(b.bitboard[BB])) bonus -= BISHOP_PAIR_BONUS;
+  // material terms (from the material table, if we have one):
+  material_entry local_material;
+  material_entry* material_info = &local_material;
+  if (materials) material_info = materials->probe(b);
+  else evaluate_material(b.material_key, &local_material);
+  bonus += material_info->imbalance;
 
-  // doubled pawn penalty:
-  bonus -= POPCOUNT(b.bitboard[WP] & (b.bitboard[WP] >> 8)) * DOUBLED_PAWN_PENALTY;
-  bonus += POPCOUNT(b.bitboard[BP] & (b.bitboard[BP] << 8)) * DOUBLED_PAWN_PENALTY;
-
-  // pawn support (pawns defending other pawns) bonus:
-  U64 wp_attacks = ((b.bitboard[WP] >> 7) & ~FILES[A]) |
-                   ((b.bitboard[WP] >> 9) & ~FILES[H]);
-  U64 bp_attacks = ((b.bitboard[BP] << 7) & ~FILES[H]) | 
-                   ((b.bitboard[BP] << 9) & ~FILES[A]);
-  bonus += POPCOUNT(b.bitboard[WP] & wp_attacks) * PAWN_SUPPORT_BONUS;
-  bonus -= POPCOUNT(b.bitboard[BP] & bp_attacks) * PAWN_SUPPORT_BONUS;
-
-  // isolated and passed pawn penalty/bonus:
-  /* U64 wp = b.bitboard[WP];
-  U64 bp = b.bitboard[BP];
-  int index;
-  while (wp) {
-    index = LSB(wp);
-    if (!(b.bitboard[WP] & ISOLATED_MASKS[index])) bonus -= ISOLATED_PAWN_PENALTY;
-    // if (!(b.bitboard[BP] & WHITE_PASSED_PAWN_MASKS[index])) bonus += PASSED_PAWN_BONUS[RANK_NO(index)];
-    POP_LSB(wp);
-  }
-  while (bp) {
-    index = LSB(bp);
-    if (!(b.bitboard[BP] & ISOLATED_MASKS[index])) bonus += ISOLATED_PAWN_PENALTY;
-    // if (!(b.bitboard[WP] & BLACK_PASSED_PAWN_MASKS[index])) bonus -= PASSED_PAWN_BONUS[9 - RANK_NO(index)];
-    POP_LSB(bp);
-  } */
+  // pawn structure (from the pawn table, if we have one):
+  pawn_entry local_entry;
+  pawn_entry* pawn_info = &local_entry;
+  if (pawns) pawn_info = pawns->probe(b);
+  else evaluate_pawns(b, &local_entry);
+  bonus += pawn_info->score;
 
   // semi-open and fully-open rook files:
+  U64 open_files = pawn_info->semi_open_files[0] & pawn_info->semi_open_files[1];
   U64 wr = b.bitboard[WR] | b.bitboard[WQ];
   U64 br = b.bitboard[BR] | b.bitboard[BQ];
   int index;
   while (wr) {
     index = LSB(wr);
-    if (!((b.bitboard[WP] | b.bitboard[BP]) & SQUARE_FILES[index])) bonus += FULLY_OPEN_FILE_BONUS;
-    else if (!(b.bitboard[WP] & SQUARE_FILES[index])) bonus += SEMI_OPEN_FILE_BONUS;
+    if (open_files & (1L << index)) {
+      bonus += FULLY_OPEN_FILE_BONUS;
+      TRACE(fully_open_files, 1);
+    }
+    else if (pawn_info->semi_open_files[0] & (1L << index)) {
+      bonus += SEMI_OPEN_FILE_BONUS;
+      TRACE(semi_open_files, 1);
+    }
     POP_LSB(wr);
   }
   while (br) {
     index = LSB(br);
-    if (!((b.bitboard[WP] | b.bitboard[BP]) & SQUARE_FILES[index])) bonus -= FULLY_OPEN_FILE_BONUS;
-    else if (!(b.bitboard[BP] & SQUARE_FILES[index])) bonus -= SEMI_OPEN_FILE_BONUS;
+    if (open_files & (1L << index)) {
+      bonus -= FULLY_OPEN_FILE_BONUS;
+      TRACE(fully_open_files, -1);
+    }
+    else if (pawn_info->semi_open_files[1] & (1L << index)) {
+      bonus -= SEMI_OPEN_FILE_BONUS;
+      TRACE(semi_open_files, -1);
+    }
     POP_LSB(br);
   }
 
-  // piece mobility evaluation:
-  /* U64 not_pinned_white;
-  U64 not_pinned_black;
-  if (b.turn == WHITE) {
-    not_pinned_white = ~(b.pinned_pieces());
-
-    // get opponent's pinned pieces by flipping the turn and getting pinned pieces:
-    b.turn = BLACK;
-    not_pinned_black = ~(b.pinned_pieces());
-    b.turn = WHITE;
-  }
-  else {
-    not_pinned_black = ~(b.pinned_pieces());
-
-    // get opponent's pinned pieces by flipping the turn and getting pinned pieces:
-    b.turn = WHITE;
-    not_pinned_white = ~(b.pinned_pieces());
-    b.turn = BLACK;
-  }
+  // piece mobility evaluation (the pins and, with b.attacks(true), the attack
+  // maps of both sides are cached per node):
+  /* U64 not_pinned_white = ~b.attacks().pinned[0];
+  U64 not_pinned_black = ~b.attacks().pinned[1];
 
   U64 knights = b.bitboard[WN] & not_pinned_white;
   while (knights) {
@@ -107,23 +95,157 @@ int evaluate() {
   // bonus += __builtin_popcountll(KING_MOVES[LSB(b.bitboard[WK])] & b.bitboard[WP]) * KING_SHIELD_BONUS;
   // bonus -= __builtin_popcountll(KING_MOVES[LSB(b.bitboard[BK])] & b.bitboard[BP]) * KING_SHIELD_BONUS;
 
-  // calculate base score based on game phase (tapered evaluation):
-  int base_score;
-  if (b.game_phase_score > OPENING_PHASE_SCORE) base_score = b.base_score_opening;
-  else if (b.game_phase_score < ENDGAME_PHASE_SCORE) base_score = b.base_score_endgame;
-  else {
-    base_score = (
-                    b.base_score_opening * b.game_phase_score +
-                    b.base_score_endgame * (OPENING_PHASE_SCORE - b.game_phase_score)
-                 ) / OPENING_PHASE_SCORE;
+  // calculate base score based on game phase (tapered evaluation). the phase is
+  // already clamped, and drawish endgames are scaled down towards 0:
+  int phase = material_info->phase;
+  int opening_score = OPENING_SCORE(b.base_score);
+  int endgame_score = ENDGAME_SCORE(b.base_score);
+  int scale = material_info->scale[endgame_score < 0];
+  endgame_score = endgame_score * scale / SCALE_NORMAL;
+  int base_score = (
+                     opening_score * phase +
+                     endgame_score * (OPENING_PHASE_SCORE - phase)
+                   ) / OPENING_PHASE_SCORE;
+
+#ifdef EVAL_TRACE
+  // the PST terms (black's PSTs are white's, mirrored and negated):
+  if (eval_trace_target) {
+    for (int piece = WP; piece <= BK; piece++) {
+      U64 pieces = b.bitboard[piece];
+      while (pieces) {
+        index = LSB(pieces);
+        if (piece < BLACK) eval_trace_target->piece_square[piece][index]++;
+        else eval_trace_target->piece_square[piece - BLACK][index ^ 56]--;
+        POP_LSB(pieces);
+      }
+    }
+    eval_trace_target->phase = phase;
+    eval_trace_target->scale = scale;
   }
+#endif
 
   // return the evaluation relative to the side whose turn it is:
   return (base_score + bonus) * (b.turn == WHITE ? 1 : -1);
 }
 
-// see(): static exchange evaluation - is this static exchange going to be good for us?
-/* int see(int move) {
+// evaluate_pawns(): evaluates the terms that only depend on the pawns:
+void evaluate_pawns(board& b, pawn_entry* entry) {
+  U64 wp = b.bitboard[WP];
+  U64 bp = b.bitboard[BP];
+  int score = 0;
+
+  // doubled pawn penalty:
+  score -= POPCOUNT(wp & (wp >> 8)) * DOUBLED_PAWN_PENALTY;
+  score += POPCOUNT(bp & (bp << 8)) * DOUBLED_PAWN_PENALTY;
+  TRACE(doubled_pawns, POPCOUNT(bp & (bp << 8)) - POPCOUNT(wp & (wp >> 8)));
+
+  // pawn support (pawns defending other pawns) bonus:
+  U64 wp_attacks = ((wp >> 7) & ~FILES[A]) | ((wp >> 9) & ~FILES[H]);
+  U64 bp_attacks = ((bp << 7) & ~FILES[H]) | ((bp << 9) & ~FILES[A]);
+  score += POPCOUNT(wp & wp_attacks) * PAWN_SUPPORT_BONUS;
+  score -= POPCOUNT(bp & bp_attacks) * PAWN_SUPPORT_BONUS;
+
+  // passed pawns (isolated and passed pawn terms aren't scored yet):
+  entry->passed_pawns[0] = entry->passed_pawns[1] = 0L;
+  U64 pawns = wp;
+  int index;
+  while (pawns) {
+    index = LSB(pawns);
+    if (!(bp & WHITE_PASSED_PAWN_MASKS[index])) entry->passed_pawns[0] |= (1L << index);
+    // if (!(wp & ISOLATED_MASKS[index])) score -= ISOLATED_PAWN_PENALTY;
+    POP_LSB(pawns);
+  }
+  pawns = bp;
+  while (pawns) {
+    index = LSB(pawns);
+    if (!(wp & BLACK_PASSED_PAWN_MASKS[index])) entry->passed_pawns[1] |= (1L << index);
+    // if (!(bp & ISOLATED_MASKS[index])) score += ISOLATED_PAWN_PENALTY;
+    POP_LSB(pawns);
+  }
+
+  // files without pawns of either color (for the rook file terms):
+  entry->semi_open_files[0] = entry->semi_open_files[1] = 0L;
+  for (int file = A; file <= H; file++) {
+    if (!(wp & FILES[file])) entry->semi_open_files[0] |= FILES[file];
+    if (!(bp & FILES[file])) entry->semi_open_files[1] |= FILES[file];
+  }
+
+  entry->key = b.pawn_hash;
+  entry->score = score;
+}
+
+pawn_entry* pawn_table::probe(board& b) {
+  pawn_entry* entry = &entries[b.pawn_hash & (PAWN_TABLE_SIZE - 1)];
+  if (entry->key != b.pawn_hash) evaluate_pawns(b, entry);
+  return entry;
+}
+
+int eval_table::probe(board& b, pawn_table* pawns, material_table* materials) {
+  eval_entry* entry = &entries[b.hash & (EVAL_TABLE_SIZE - 1)];
+  if (entry->key == b.hash) return entry->score;
+  entry->key = b.hash;
+  entry->score = evaluate(b, pawns, materials);
+  return entry->score;
+}
+
+// evaluate_material(): evaluates the terms that only depend on the piece counts:
+void evaluate_material(U64 key, material_entry* entry) {
+  int count[12];
+  for (int piece = WP; piece < NONE; piece++) count[piece] = MATERIAL_COUNT(key, piece);
+
+  // the game phase (outside of [ENDGAME_PHASE_SCORE, OPENING_PHASE_SCORE], the
+  // score is the pure opening or endgame score):
+  int phase = 0;
+  for (int piece = WN; piece < BK; piece++) phase += count[piece] * GAME_PHASE_MATERIAL_SCORE[piece];
+  if (phase > OPENING_PHASE_SCORE) phase = OPENING_PHASE_SCORE;
+  else if (phase < ENDGAME_PHASE_SCORE) phase = 0;
+  entry->phase = phase;
+
+  // bishop pair bonus:
+  entry->imbalance = 0;
+  if (count[WB] >= 2) entry->imbalance += BISHOP_PAIR_BONUS;
+  if (count[BB] >= 2) entry->imbalance -= BISHOP_PAIR_BONUS;
+  TRACE(bishop_pair, (count[WB] >= 2) - (count[BB] >= 2));
+
+  // insufficient material: no pawns, rooks or queens, one side has a bare king,
+  // and the other has a single minor piece or two knights:
+  int knights = count[WN] + count[BN];
+  int bishops = count[WB] + count[BB];
+  entry->is_draw = !(count[WP] + count[BP] + count[WR] + count[BR] + count[WQ] + count[BQ]) &&
+                   (!(count[WN] + count[WB]) || !(count[BN] + count[BB])) &&
+                   (knights + bishops <= 1 || (!bishops && knights <= 2));
+
+  // a side without pawns that is at most a minor piece ahead can hardly win
+  // (scale factors from stockfish):
+  for (int side = 0; side < 2; side++) {
+    int us = side ? BLACK : WHITE;
+    int them = side ? WHITE : BLACK;
+    int npm_us = 0, npm_them = 0;
+    for (int piece = KNIGHT; piece <= QUEEN; piece++) {
+      npm_us += count[us + piece] * GAME_PHASE_MATERIAL_SCORE[us + piece];
+      npm_them += count[them + piece] * GAME_PHASE_MATERIAL_SCORE[them + piece];
+    }
+
+    entry->scale[side] = SCALE_NORMAL;
+    if (!count[us + PAWN] && npm_us - npm_them <= GAME_PHASE_MATERIAL_SCORE[WB]) {
+      if (npm_us < GAME_PHASE_MATERIAL_SCORE[WR]) entry->scale[side] = 0;
+      else entry->scale[side] = (npm_them <= GAME_PHASE_MATERIAL_SCORE[WB]) ? 4 : 14;
+    }
+  }
+
+  entry->key = key;
+}
+
+material_entry* material_table::probe(board& b) {
+  material_entry* entry = &entries[((b.material_key * 0x9E3779B97F4A7C15ULL) >> 32) & (MATERIAL_TABLE_SIZE - 1)];
+  if (entry->key != b.material_key) evaluate_material(b.material_key, entry);
+  return entry;
+}
+
+// see(): static exchange evaluation - does this move win at least `threshold`
+// centipawns once all the captures on its TO-square are played out?
+// code is based on andrew grant's ethereal engine
+bool see(board& b, int move, int threshold) {
   // unpack move info:
   int to = MOVE_TO(move);
   int from = MOVE_FROM(move);
@@ -132,22 +254,22 @@ int evaluate() {
       b.piece_board[from];
 
   // declare the move balance score:
-  int balance = estimated_move_value(move);
+  int balance = estimated_move_value(b, move) - threshold;
 
   // if the balance is losing as-is, we terminate early:
-  if (balance < 0) return balance;
+  if (balance < 0) return false;
 
-  // worst case is losing the capturing piece.
-  // if the balance is positive then we can stop the exchange here and be up material
-  // from the exchange, so we can stop early as well:
-  if (balance - SEE_PIECE_VALUES[next_victim] > 0) return balance;
+  // worst case is losing the capturing piece. if we're still ahead after that,
+  // we can stop the exchange here:
+  balance -= SEE_PIECE_VALUES[next_victim];
+  if (balance >= 0) return true;
 
   // get sliders to help update hidden attackers:
   U64 bishops = b.bitboard[WB] | b.bitboard[BB] | b.bitboard[WQ] | b.bitboard[BQ];
   U64 rooks   = b.bitboard[WR] | b.bitboard[BR] | b.bitboard[WQ] | b.bitboard[BQ];
 
   // get OCCUPIED board and make the move on it:
-  U64 occupied = (b.OCCUPIED_SQUARES ^ (1L << from)) | (1L << to);
+  U64 occupied = ((b.W | b.B) ^ (1L << from)) | (1L << to);
   if (MOVE_IS_EP(move)) {
     char ep_square = (b.turn == WHITE) ? to + 8 : to - 8;
     occupied ^= (1L << ep_square);
@@ -156,14 +278,18 @@ int evaluate() {
   // get all attackers for this square:
   U64 attackers = b.get_attackers(occupied, to) & occupied;
 
-  char turn = (b.turn == WHITE) ? BLACK : WHITE;
+  // pieces pinned to their king can't join the exchange while the pinner is
+  // still on the board:
+  const attack_info& info = b.attacks();
 
-  // now we do SEE:
+  // now we play out the exchange, always capturing with the least valuable piece:
+  char turn = (b.turn == WHITE) ? BLACK : WHITE;
   U64 my_attackers;
-  int previous_attacker = b.piece_board[from];
-  do {
+  while (true) {
     // if we don't have any more attackers, we lose:
     my_attackers = attackers & (turn == WHITE ? b.W : b.B);
+    int side = (turn == WHITE) ? 0 : 1;
+    if (info.pinners[side] & occupied) my_attackers &= ~info.pinned[side];
     if (!my_attackers) break;
 
     // find weakest piece to attack with:
@@ -171,8 +297,9 @@ int evaluate() {
       if (my_attackers & b.bitboard[turn + next_victim]) break;
     }
 
-    // remove this attacker from occupied:
-    occupied ^= (1L << LSB(my_attackers & b.bitboard[turn + next_victim]));
+    // remove this attacker from occupied, and add any attackers behind it:
+    my_attackers &= b.bitboard[turn + next_victim];
+    occupied ^= (1L << LSB(my_attackers));
 
     if (next_victim == PAWN || next_victim == BISHOP || next_victim == QUEEN) {
       attackers |= diag_moves_magic(to, occupied) & bishops;
@@ -185,40 +312,35 @@ int evaluate() {
     attackers &= occupied;
     turn = (turn == WHITE) ? BLACK : WHITE;
 
-    // negamax the balance score and add the score of the next victim:
-    balance = -balance + SEE_PIECE_VALUES[previous_attacker];
-    previous_attacker = next_victim;
+    // negamax the balance and lose the capturing piece:
+    balance = -balance - 1 - SEE_PIECE_VALUES[turn + next_victim];
 
-    // if we're doing better than our opponent, we can break as well:
-    if (balance >= 0) break;
-  } while (true);
-
-  // there might be one last capture available:
-  my_attackers = attackers & (turn == WHITE ? b.W : b.B);
-  if (my_attackers) {
-    balance = -balance + SEE_PIECE_VALUES[previous_attacker];
-    turn = (turn == WHITE) ? BLACK : WHITE;
+    // if the side to move is ahead even after losing this piece, it wins.
+    // (a king can't capture into a defended square, so it loses instead):
+    if (balance >= 0) {
+      if (next_victim == KING && (attackers & (turn == WHITE ? b.W : b.B))) {
+        turn = (turn == WHITE) ? BLACK : WHITE;
+      }
+      break;
+    }
   }
 
-  // return the balance with respect to the player whose turn it is:
-  return (b.turn == turn) ? -balance : balance;
+  // the side to move at the end of the exchange is the side that lost it:
+  return b.turn != turn;
 }
 
 // estimated_move_value(): roughly estimate the move's value.
 // code is straight from andrew grant's ethereal engine
-int estimated_move_value(int move) {
-  int value = SEE_PIECE_VALUES[b.piece_board[MOVE_TO(move)]];
+int estimated_move_value(board& b, int move) {
+  // the captured piece (NONE is worth 0, and en passant moves capture a pawn):
+  int value = SEE_PIECE_VALUES[MOVE_CAPTURED(move)];
 
   if (MOVE_IS_PROMOTION(move)) {
     value += SEE_PIECE_VALUES[MOVE_PROMOTION_PIECE(move)] - SEE_PIECE_VALUES[PAWN];
   }
 
-  else if (MOVE_IS_EP(move)) value = SEE_PIECE_VALUES[PAWN];
-
-  else if (MOVE_IS_CASTLE(move)) value = 0;
-
   return value;
-} */
+}
 
 // gives_check(): does this move give check?
 // ASSUMES UNSAFE BITBOARD HAS BEEN UPDATED!
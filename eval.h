@@ -5,12 +5,140 @@
 #include "defs.h"
 #include "globals.h"
 
-// the main evaluation function:
-int evaluate();
+// pawn_entry: everything the evaluation knows about a pawn structure, which
+// only changes when a pawn moves or is captured:
+struct pawn_entry {
+  U64 key; // the board's pawn_hash
+  int score; // all pawn-only terms, relative to white
+  U64 passed_pawns[2]; // [0] = white's passed pawns, [1] = black's
+  U64 semi_open_files[2]; // [0] = files without white pawns, [1] = without black pawns
+};
+
+/* pawn_table: a small always-replace hash table of pawn entries, indexed by
+ * the pawn hash. every search thread has its own, so there's no locking, and
+ * since pawn structures repeat across almost all nodes of a search, nearly
+ * every evaluation finds its pawn entry here.
+*/
+#define PAWN_TABLE_SIZE 8192 // must be a power of 2
+
+struct pawn_table {
+  pawn_entry entries[PAWN_TABLE_SIZE];
+
+  pawn_table() { clear(); }
+
+  // clear(): empty the table. no real pawn hash is ~0 (with all but certainty),
+  // unlike 0, which is the hash of every position without pawns:
+  void clear() {
+    for (int i = 0; i < PAWN_TABLE_SIZE; i++) entries[i].key = ~0ULL;
+  }
+
+  // probe(): the entry for the board's pawn structure (evaluated on a miss):
+  pawn_entry* probe(board& b);
+};
+
+// material_entry: everything the evaluation knows about a material signature
+// (the piece counts of both sides, see MATERIAL_KEY):
+struct material_entry {
+  U64 key; // the board's material_key
+  int phase; // the game phase, clamped to [0, OPENING_PHASE_SCORE] for tapering
+  int imbalance; // all material-only terms, relative to white
+  int scale[2]; // endgame scale factor (out of SCALE_NORMAL) if [0] = white, [1] = black is ahead
+  bool is_draw; // neither side has enough material to mate
+};
+
+// the endgame scale factor of material signatures that play out normally:
+#define SCALE_NORMAL 64
+
+/* material_table: a small always-replace hash table of material entries,
+ * indexed by the material key. material signatures change even less often
+ * than pawn structures, so with one table per search thread, the draw check
+ * and all the material terms cost a single lookup per node.
+*/
+#define MATERIAL_TABLE_SIZE 4096 // must be a power of 2
+
+struct material_table {
+  material_entry entries[MATERIAL_TABLE_SIZE];
+
+  material_table() { clear(); }
+
+  // clear(): empty the table (every real material key counts two kings):
+  void clear() {
+    for (int i = 0; i < MATERIAL_TABLE_SIZE; i++) entries[i].key = 0;
+  }
+
+  // probe(): the entry for the board's material signature (evaluated on a miss):
+  material_entry* probe(board& b);
+};
+
+// eval_entry: a cached static evaluation:
+struct eval_entry {
+  U64 key; // the board's hash
+  int score; // relative to the side to move, like evaluate()
+};
+
+/* eval_table: a small always-replace hash table of static evaluations, indexed
+ * by the zobrist hash. like the pawn table, every search thread has its own.
+ * it's lossy (a newer position simply overwrites an older one), and only saves
+ * the evaluations of transpositions the TT doesn't know about, such as the
+ * quiescence nodes (which don't store TT entries).
+*/
+#define EVAL_TABLE_SIZE 16384 // must be a power of 2
+
+struct eval_table {
+  eval_entry entries[EVAL_TABLE_SIZE];
+
+  eval_table() { clear(); }
+
+  // clear(): empty the table (the hash of a position is never 0 in practice):
+  void clear() {
+    for (int i = 0; i < EVAL_TABLE_SIZE; i++) entries[i].key = 0;
+  }
+
+  // contains(): is the evaluation of the position with this hash in the table?
+  bool contains(U64 hash) { return entries[hash & (EVAL_TABLE_SIZE - 1)].key == hash; }
+
+  // probe(): the static evaluation of the board (evaluated on a miss):
+  int probe(board& b, pawn_table* pawns, material_table* materials);
+};
+
+// the main evaluation function (relative to the side to move on board b).
+// with a pawn table and a material table, the pawn structure and material
+// terms are cached in them:
+int evaluate(board& b, pawn_table* pawns = NULL, material_table* materials = NULL);
+
+// evaluate_pawns(): fill in the pawn entry for the board's pawn structure:
+void evaluate_pawns(board& b, pawn_entry* entry);
+
+// evaluate_material(): fill in the material entry for the given material key:
+void evaluate_material(U64 key, material_entry* entry);
+
+/* eval_trace: the coefficients of the tunable evaluation terms (relative to
+ * white) in the last evaluate() call, for the tuner. the evaluation is linear
+ * in all of them, except that the PSTs are tapered by the phase and the
+ * endgame scale factor, which are traced as well. tracing is only compiled in
+ * with -DEVAL_TRACE ('make tune' does that), and only happens while
+ * eval_trace_target is set, for evaluations without a pawn or material table.
+*/
+struct eval_trace {
+  int bishop_pair;
+  int doubled_pawns;
+  int fully_open_files;
+  int semi_open_files;
+  int piece_square[6][64]; // white's pieces on each square minus black's on the mirrored square
+  int phase; // the material entry's phase
+  int scale; // the endgame scale factor that was applied
+};
+
+#ifdef EVAL_TRACE
+extern eval_trace* eval_trace_target;
+#define TRACE(term, coefficient) if (eval_trace_target) eval_trace_target->term += (coefficient)
+#else
+#define TRACE(term, coefficient)
+#endif
 
 // SEE and helper functions:
-// int see(int move);
-// int estimated_move_value(int move);
+bool see(board& b, int move, int threshold);
+int estimated_move_value(board& b, int move);
 
 // bool gives_check(int move);
 
@@ -369,6 +369,8 @@ int PIECE_SQUARE_TABLE[2][12][64] = {{
  }
 }};
 
+int PIECE_SQUARE_SCORE[12][64];
+
 // {0, 0, 3, 10, 20, 30, 40, 50, 60};
 int PASSED_PAWN_BONUS[9] = {0, 0, 3, 10, 25, 45, 70, 100, 0};
 
@@ -47,6 +47,10 @@ extern int PIECE_TO_MATERIAL[2][13];
 // the piece-square tables
 extern int PIECE_SQUARE_TABLE[2][12][64];
 
+// the piece-square tables (with material) as packed S(opening, endgame) scores,
+// built from PIECE_SQUARE_TABLE by init_consts():
+extern int PIECE_SQUARE_SCORE[12][64];
+
 extern int PASSED_PAWN_BONUS[9];
 extern int RAZOR_MARGIN[10];
 extern int SEE_PIECE_VALUES[13];
@@ -0,0 +1,294 @@
+// GEN_TABLES.CPP: generates tables.cpp, which holds every attack table and the
+// zobrist keys as read-only data. the engine used to compute these in
+// init_consts() on every start; now they're computed once, at build time, and
+// live in the binary's read-only data (so they load instantly and their pages
+// are shared between engine processes). run as: ./gen_tables.out > tables.cpp
+#include <stdio.h>
+#include <random>
+
+#include "defs.h"
+
+// magic numbers for rooks and bishops:
+const U64 ROOK_MAGICS[64] = {
+    0xa8002c000108020ULL, 0x6c00049b0002001ULL, 0x100200010090040ULL, 0x2480041000800801ULL, 0x280028004000800ULL,
+    0x900410008040022ULL, 0x280020001001080ULL, 0x2880002041000080ULL, 0xa000800080400034ULL, 0x4808020004000ULL,
+    0x2290802004801000ULL, 0x411000d00100020ULL, 0x402800800040080ULL, 0xb000401004208ULL, 0x2409000100040200ULL,
+    0x1002100004082ULL, 0x22878001e24000ULL, 0x1090810021004010ULL, 0x801030040200012ULL, 0x500808008001000ULL,
+    0xa08018014000880ULL, 0x8000808004000200ULL, 0x201008080010200ULL, 0x801020000441091ULL, 0x800080204005ULL,
+    0x1040200040100048ULL, 0x120200402082ULL, 0xd14880480100080ULL, 0x12040280080080ULL, 0x100040080020080ULL,
+    0x9020010080800200ULL, 0x813241200148449ULL, 0x491604001800080ULL, 0x100401000402001ULL, 0x4820010021001040ULL,
+    0x400402202000812ULL, 0x209009005000802ULL, 0x810800601800400ULL, 0x4301083214000150ULL, 0x204026458e001401ULL,
+    0x40204000808000ULL, 0x8001008040010020ULL, 0x8410820820420010ULL, 0x1003001000090020ULL, 0x804040008008080ULL,
+    0x12000810020004ULL, 0x1000100200040208ULL, 0x430000a044020001ULL, 0x280009023410300ULL, 0xe0100040002240ULL,
+    0x200100401700ULL, 0x2244100408008080ULL, 0x8000400801980ULL, 0x2000810040200ULL, 0x8010100228810400ULL,
+    0x2000009044210200ULL, 0x4080008040102101ULL, 0x40002080411d01ULL, 0x2005524060000901ULL, 0x502001008400422ULL,
+    0x489a000810200402ULL, 0x1004400080a13ULL, 0x4000011008020084ULL, 0x26002114058042ULL
+};
+
+const U64 BISHOP_MAGICS[64] = {
+    0x89a1121896040240ULL, 0x2004844802002010ULL, 0x2068080051921000ULL, 0x62880a0220200808ULL, 0x4042004000000ULL,
+    0x100822020200011ULL, 0xc00444222012000aULL, 0x28808801216001ULL, 0x400492088408100ULL, 0x201c401040c0084ULL,
+    0x840800910a0010ULL, 0x82080240060ULL, 0x2000840504006000ULL, 0x30010c4108405004ULL, 0x1008005410080802ULL,
+    0x8144042209100900ULL, 0x208081020014400ULL, 0x4800201208ca00ULL, 0xf18140408012008ULL, 0x1004002802102001ULL,
+    0x841000820080811ULL, 0x40200200a42008ULL, 0x800054042000ULL, 0x88010400410c9000ULL, 0x520040470104290ULL,
+    0x1004040051500081ULL, 0x2002081833080021ULL, 0x400c00c010142ULL, 0x941408200c002000ULL, 0x658810000806011ULL,
+    0x188071040440a00ULL, 0x4800404002011c00ULL, 0x104442040404200ULL, 0x511080202091021ULL, 0x4022401120400ULL,
+    0x80c0040400080120ULL, 0x8040010040820802ULL, 0x480810700020090ULL, 0x102008e00040242ULL, 0x809005202050100ULL,
+    0x8002024220104080ULL, 0x431008804142000ULL, 0x19001802081400ULL, 0x200014208040080ULL, 0x3308082008200100ULL,
+    0x41010500040c020ULL, 0x4012020c04210308ULL, 0x208220a202004080ULL, 0x111040120082000ULL, 0x6803040141280a00ULL,
+    0x2101004202410000ULL, 0x8200000041108022ULL, 0x21082088000ULL, 0x2410204010040ULL, 0x40100400809000ULL,
+    0x822088220820214ULL, 0x40808090012004ULL, 0x910224040218c9ULL, 0x402814422015008ULL, 0x90014004842410ULL,
+    0x1000042304105ULL, 0x10008830412a00ULL, 0x2520081090008908ULL, 0x40102000a0a60140ULL,
+};
+
+// number of index bits for each square's hash table:
+const int ROOK_INDEX_BITS[64] = {
+    12, 11, 11, 11, 11, 11, 11, 12,
+    11, 10, 10, 10, 10, 10, 10, 11,
+    11, 10, 10, 10, 10, 10, 10, 11,
+    11, 10, 10, 10, 10, 10, 10, 11,
+    11, 10, 10, 10, 10, 10, 10, 11,
+    11, 10, 10, 10, 10, 10, 10, 11,
+    11, 10, 10, 10, 10, 10, 10, 11,
+    12, 11, 11, 11, 11, 11, 11, 12
+};
+
+const int BISHOP_INDEX_BITS[64] = {
+    6, 5, 5, 5, 5, 5, 5, 6,
+    5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 7, 7, 7, 7, 5, 5,
+    5, 5, 7, 9, 9, 7, 5, 5,
+    5, 5, 7, 9, 9, 7, 5, 5,
+    5, 5, 7, 7, 7, 7, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5,
+    6, 5, 5, 5, 5, 5, 5, 6
+};
+
+// the zobrist keys are drawn from a fixed seed, so that they (and with them,
+// every TT-dependent search result) are the same from run to run:
+const unsigned long ZOBRIST_SEED = 0x4c554e41; // "LUNA"
+
+// the tables we generate:
+U64 KNIGHT_MOVES[64];
+U64 KING_MOVES[64];
+U64 RECT_LOOKUP[64][64];
+U64 LINE_LOOKUP[64][64];
+U64 ROOK_MASKS[64];
+U64 BISHOP_MASKS[64];
+U64 ROOK_TABLE[64][4096];
+U64 BISHOP_TABLE[64][512];
+U64 SLIDER_TABLE[107648];
+int ROOK_OFFSETS[64];
+int BISHOP_OFFSETS[64];
+U64 ZOBRIST_SQUARE_KEYS[12][64];
+U64 ZOBRIST_CASTLE_RIGHTS_KEYS[16];
+U64 ZOBRIST_EP_KEYS[8];
+U64 ZOBRIST_TURN_KEY;
+
+// ray_attacks(): slider attacks from square s in the given directions (a ray
+// stops at, and includes, the first occupied square). slow, but simple:
+U64 ray_attacks(int s, U64 occupied, const int directions[4][2]) {
+  U64 attacks = 0L;
+  for (int d = 0; d < 4; d++) {
+    int rank = s / 8 + directions[d][0];
+    int file = s % 8 + directions[d][1];
+    while (rank >= 0 && rank < 8 && file >= 0 && file < 8) {
+      attacks |= (1ULL << (rank * 8 + file));
+      if (occupied & (1ULL << (rank * 8 + file))) break;
+      rank += directions[d][0];
+      file += directions[d][1];
+    }
+  }
+  return attacks;
+}
+
+const int LINE_DIRECTIONS[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+const int DIAG_DIRECTIONS[4][2] = {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+
+U64 line_attacks(int s, U64 occupied) { return ray_attacks(s, occupied, LINE_DIRECTIONS); }
+U64 diag_attacks(int s, U64 occupied) { return ray_attacks(s, occupied, DIAG_DIRECTIONS); }
+
+// step_attacks(): attacks of a piece that jumps by the given (rank, file) offsets:
+U64 step_attacks(int s, const int steps[8][2]) {
+  U64 attacks = 0L;
+  for (int i = 0; i < 8; i++) {
+    int rank = s / 8 + steps[i][0];
+    int file = s % 8 + steps[i][1];
+    if (rank >= 0 && rank < 8 && file >= 0 && file < 8) attacks |= (1ULL << (rank * 8 + file));
+  }
+  return attacks;
+}
+
+const int KNIGHT_STEPS[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+const int KING_STEPS[8][2] = {{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}};
+
+// in_between(): given indices of two squares, returns 0 if there is no line
+// between them, and 1s along the line between them (in any direction) otherwise
+// (from chessprogramming.org):
+U64 in_between(int sq1, int sq2) {
+   const U64 m1   = -1L;
+   const U64 a2a7 = 0x0001010101010100L;
+   const U64 b2g7 = 0x0040201008040200L;
+   const U64 h1b7 = 0x0002040810204080L; /* Thanks Dustin, g2b7 did not work for c1-a3 */
+   U64 btwn, line, rank, file;
+
+   btwn  = (m1 << sq1) ^ (m1 << sq2);
+   file  =   (sq2 & 7) - (sq1   & 7);
+   rank  =  ((sq2 | 7) -  sq1) >> 3 ;
+   line  =      (   (file  &  7) - 1) & a2a7; /* a2a7 if same file */
+   line += 2 * ((   (rank  &  7) - 1) >> 58); /* b1g1 if same rank */
+   line += (((rank - file) & 15) - 1) & b2g7; /* b2g7 if same diagonal */
+   line += (((rank + file) & 15) - 1) & h1b7; /* h1b7 if same antidiag */
+   line *= btwn & -btwn; /* mul acts like shift by smaller square */
+   return line & btwn;   /* return the bits on that line in-between */
+}
+
+// rmask(): calculates rook mask for a given square index (from chessprogramming.org)
+U64 rmask(int sq) {
+  U64 result = 0ULL;
+  int rk = sq / 8, fl = sq % 8, r, f;
+  for (r = rk+1; r <= 6; r++) result |= (1ULL << (fl + r*8));
+  for (r = rk-1; r >= 1; r--) result |= (1ULL << (fl + r*8));
+  for (f = fl+1; f <= 6; f++) result |= (1ULL << (f + rk*8));
+  for (f = fl-1; f >= 1; f--) result |= (1ULL << (f + rk*8));
+  return result;
+}
+
+// bmask(): calculates bishop mask for a given square index (from chessprogramming.org)
+U64 bmask(int sq) {
+  U64 result = 0ULL;
+  int rk = sq / 8, fl = sq % 8, r, f;
+  for (r=rk+1, f=fl+1; r<=6 && f<=6; r++, f++) result |= (1ULL << (f + r*8));
+  for (r=rk+1, f=fl-1; r<=6 && f>=1; r++, f--) result |= (1ULL << (f + r*8));
+  for (r=rk-1, f=fl+1; r>=1 && f<=6; r--, f++) result |= (1ULL << (f + r*8));
+  for (r=rk-1, f=fl-1; r>=1 && f>=1; r--, f--) result |= (1ULL << (f + r*8));
+  return result;
+}
+
+// get_blockers_from_index(): given a table index, calculate the bitboard of
+// blocking pieces. the index bits are deposited into the mask's bits from the
+// lowest up, which is also the order pext extracts them in:
+U64 get_blockers_from_index(int index, U64 mask) {
+  U64 blockers = 0L;
+  int i = 0;
+  while (mask) {
+    if (index & (1 << i)) blockers |= (mask & -mask);
+    mask &= mask - 1;
+    i++;
+  }
+  return blockers;
+}
+
+void compute_tables() {
+  // knight and king moves:
+  for (int sq = 0; sq < 64; sq++) {
+    KNIGHT_MOVES[sq] = step_attacks(sq, KNIGHT_STEPS);
+    KING_MOVES[sq] = step_attacks(sq, KING_STEPS);
+  }
+
+  // RECT_LOOKUP and LINE_LOOKUP (the squares shared by two empty-board slider
+  // attacks along the same line, plus the two squares themselves):
+  for (int i = 0; i < 64; i++) {
+    for (int j = 0; j < 64; j++) {
+      RECT_LOOKUP[i][j] = in_between(i, j);
+
+      LINE_LOOKUP[i][j] = 0L;
+      if (i == j) continue;
+      if (line_attacks(i, 0L) & (1ULL << j)) {
+        LINE_LOOKUP[i][j] = (line_attacks(i, 0L) & line_attacks(j, 0L)) | (1ULL << i) | (1ULL << j);
+      }
+      else if (diag_attacks(i, 0L) & (1ULL << j)) {
+        LINE_LOOKUP[i][j] = (diag_attacks(i, 0L) & diag_attacks(j, 0L)) | (1ULL << i) | (1ULL << j);
+      }
+    }
+  }
+
+  // magic tables:
+  for (int sq = 0; sq < 64; sq++) {
+    ROOK_MASKS[sq] = rmask(sq);
+    BISHOP_MASKS[sq] = bmask(sq);
+
+    for (int idx = 0; idx < (1 << ROOK_INDEX_BITS[sq]); idx++) {
+      U64 occ = get_blockers_from_index(idx, ROOK_MASKS[sq]);
+      ROOK_TABLE[sq][(occ * ROOK_MAGICS[sq]) >> (64 - ROOK_INDEX_BITS[sq])] = line_attacks(sq, occ);
+    }
+
+    for (int idx = 0; idx < (1 << BISHOP_INDEX_BITS[sq]); idx++) {
+      U64 occ = get_blockers_from_index(idx, BISHOP_MASKS[sq]);
+      BISHOP_TABLE[sq][(occ * BISHOP_MAGICS[sq]) >> (64 - BISHOP_INDEX_BITS[sq])] = diag_attacks(sq, occ);
+    }
+  }
+
+  // the packed PEXT table (the blocker set for index idx is at offset + idx):
+  int offset = 0;
+  for (int sq = 0; sq < 64; sq++) {
+    ROOK_OFFSETS[sq] = offset;
+    for (int idx = 0; idx < (1 << __builtin_popcountll(ROOK_MASKS[sq])); idx++) {
+      SLIDER_TABLE[offset++] = line_attacks(sq, get_blockers_from_index(idx, ROOK_MASKS[sq]));
+    }
+  }
+  for (int sq = 0; sq < 64; sq++) {
+    BISHOP_OFFSETS[sq] = offset;
+    for (int idx = 0; idx < (1 << __builtin_popcountll(BISHOP_MASKS[sq])); idx++) {
+      SLIDER_TABLE[offset++] = diag_attacks(sq, get_blockers_from_index(idx, BISHOP_MASKS[sq]));
+    }
+  }
+
+  // zobrist keys:
+  std::mt19937_64 generator(ZOBRIST_SEED);
+  for (int i = 0; i < 12; i++) {
+    for (int j = 0; j < 64; j++) {
+      ZOBRIST_SQUARE_KEYS[i][j] = generator();
+    }
+  }
+  for (int i = 0; i < 16; i++) ZOBRIST_CASTLE_RIGHTS_KEYS[i] = generator();
+  for (int i = 0; i < 8; i++) ZOBRIST_EP_KEYS[i] = generator();
+  ZOBRIST_TURN_KEY = generator();
+}
+
+// print_u64s() and print_ints(): print a flat array as a C initializer list:
+void print_u64s(const char* declaration, const U64* values, int n) {
+  printf("%s = {", declaration);
+  for (int i = 0; i < n; i++) printf("%s0x%llxULL,", (i % 4) ? " " : "\n  ", (unsigned long long) values[i]);
+  printf("\n};\n\n");
+}
+
+void print_ints(const char* declaration, const int* values, int n) {
+  printf("%s = {", declaration);
+  for (int i = 0; i < n; i++) printf("%s%d,", (i % 8) ? " " : "\n  ", values[i]);
+  printf("\n};\n\n");
+}
+
+int main() {
+  compute_tables();
+
+  printf("// TABLES.CPP: generated by gen_tables.cpp at build time. do not edit.\n");
+  printf("#include \"consts.h\"\n\n");
+
+  print_u64s("const U64 KNIGHT_MOVES[64]", KNIGHT_MOVES, 64);
+  print_u64s("const U64 KING_MOVES[64]", KING_MOVES, 64);
+  print_u64s("const U64 RECT_LOOKUP[64][64]", &RECT_LOOKUP[0][0], 64 * 64);
+  print_u64s("const U64 LINE_LOOKUP[64][64]", &LINE_LOOKUP[0][0], 64 * 64);
+  print_u64s("const U64 ROOK_MASKS[64]", ROOK_MASKS, 64);
+  print_u64s("const U64 BISHOP_MASKS[64]", BISHOP_MASKS, 64);
+
+  printf("#ifdef USE_PEXT\n");
+  print_u64s("const U64 SLIDER_TABLE[SLIDER_TABLE_SIZE]", SLIDER_TABLE, 107648);
+  print_ints("const int ROOK_OFFSETS[64]", ROOK_OFFSETS, 64);
+  print_ints("const int BISHOP_OFFSETS[64]", BISHOP_OFFSETS, 64);
+  printf("#else\n");
+  print_u64s("const U64 ROOK_MAGICS[64]", ROOK_MAGICS, 64);
+  print_u64s("const U64 BISHOP_MAGICS[64]", BISHOP_MAGICS, 64);
+  print_ints("const int ROOK_INDEX_BITS[64]", ROOK_INDEX_BITS, 64);
+  print_ints("const int BISHOP_INDEX_BITS[64]", BISHOP_INDEX_BITS, 64);
+  print_u64s("const U64 ROOK_TABLE[64][4096]", &ROOK_TABLE[0][0], 64 * 4096);
+  print_u64s("const U64 BISHOP_TABLE[64][512]", &BISHOP_TABLE[0][0], 64 * 512);
+  printf("#endif\n\n");
+
+  print_u64s("const U64 ZOBRIST_SQUARE_KEYS[12][64]", &ZOBRIST_SQUARE_KEYS[0][0], 12 * 64);
+  print_u64s("const U64 ZOBRIST_CASTLE_RIGHTS_KEYS[16]", ZOBRIST_CASTLE_RIGHTS_KEYS, 16);
+  print_u64s("const U64 ZOBRIST_EP_KEYS[8]", ZOBRIST_EP_KEYS, 8);
+  printf("const U64 ZOBRIST_TURN_KEY = 0x%llxULL;\n", (unsigned long long) ZOBRIST_TURN_KEY);
+
+  return 0;
+}
@@ -3,11 +3,12 @@
 // init_globals(): initialize global variables:
 void init_globals() {
   b = board(FEN_START);
-  TT = transposition_table(DEFAULT_TT_SIZE);
-  TT.clear();
+  num_threads = 1;
+  TT.resize(DEFAULT_TT_SIZE);
 
   stop_search = false;
   quit_flag = false;
+  read_gui_input = true;
   time_set = false;
 }
 
@@ -16,21 +17,10 @@ void init_globals() {
 // the board is initialized here but is re-initialized on main(). it's only
 // initialized here because this is the only constructor available.
 board b(FEN_START);
-int nodes_evaluated;
 
-// for following and scoring the PV:
-bool follow_pv;
-bool score_pv;
-
-// the principal variation table:
-int pv_length[MAX_SEARCH_PLY];
-int pv_table[MAX_SEARCH_PLY][MAX_SEARCH_PLY];
-
-// to store killer moves and history moves:
-int killer_moves[2][MAX_SEARCH_PLY]; // [move_id][ply]
-int history_moves[12][64]; // [piece][square]
-
-int static_evals[MAX_SEARCH_PLY];
+// the lazy SMP searchers (created on demand by search()):
+std::vector<search_thread*> search_threads;
+int num_threads;
 
 /* ---------- TRANSPOSITION TABLE GLOBALS ---------- */
 
@@ -39,11 +29,14 @@ transposition_table TT(0);
 /* ---------- TIME CONTROL RELATED GLOBALS ---------- */
 
 // if this flag is turned on, quit the search as soon as possible
-bool stop_search;
+std::atomic<bool> stop_search;
 
 // did we get the quit command while thinking?
 bool quit_flag;
 
+// do searches listen for GUI input?
+bool read_gui_input;
+
 // are we using time control?
 bool time_set;
 
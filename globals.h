@@ -2,7 +2,9 @@
 #ifndef GLOBALS_H
 #define GLOBALS_H
 
+#include <atomic>
 #include <cstring>
+#include <vector>
 
 #include "board.h"
 #include "tt.h"
@@ -11,27 +13,21 @@
 struct tt_entry;
 struct transposition_table;
 
+// forward declaration of a single searcher (defined in engine.h):
+struct search_thread;
+
 // init_globals(): initialize global variables:
 void init_globals();
 
 /* ---------- SEARCH RELATED GLOBALS ---------- */
 
+// the position we're playing from (each search thread searches its own copy):
 extern board b;
-extern int nodes_evaluated;
-
-// for following and scoring the PV:
-extern bool follow_pv;
-extern bool score_pv;
-
-// the principal variation table:
-extern int pv_length[MAX_SEARCH_PLY];
-extern int pv_table[MAX_SEARCH_PLY][MAX_SEARCH_PLY];
 
-// to store killer moves and history moves:
-extern int killer_moves[2][MAX_SEARCH_PLY]; // [move_id][ply]
-extern int history_moves[12][64]; // [piece][square]
-
-extern int static_evals[MAX_SEARCH_PLY];
+// the lazy SMP searchers (search_threads[0] is the main thread), and how many
+// of them the next search will use (UCI 'Threads' option):
+extern std::vector<search_thread*> search_threads;
+extern int num_threads;
 
 /* ---------- TRANSPOSITION TABLE GLOBALS ---------- */
 
@@ -40,11 +36,15 @@ extern transposition_table TT;
 /* ---------- TIME CONTROL RELATED GLOBALS ---------- */
 
 // if this flag is turned on, quit the search as soon as possible
-extern bool stop_search;
+// (atomic since it's read by every search thread):
+extern std::atomic<bool> stop_search;
 
 // did we get the quit command while thinking?
 extern bool quit_flag;
 
+// do searches listen for GUI input? (not when run from the command line)
+extern bool read_gui_input;
+
 // are we using time control?
 extern bool time_set;
 
@@ -7,6 +7,7 @@
 #include "defs.h"
 #include "engine.h"
 #include "eval_params.h"
+#include "nnue.h"
 #include "tt.h"
 #include "uci.h"
 #include "utils.h"
@@ -14,7 +15,19 @@
 int main(int argc, char** argv) {
   init_consts();
   init_eval_params();
+  init_nnue();
   init_globals();
+
+  // 'main.out bench [depth] [threads] [hash] [json]' runs the bench and exits
+  // (without a GUI to listen to):
+  if (argc > 1 && !strcmp(argv[1], "bench")) {
+    read_gui_input = false;
+    std::string command = "bench";
+    for (int i = 2; i < argc; i++) command += std::string(" ") + argv[i];
+    parse_bench((char*) command.c_str());
+    return 0;
+  }
+
   uci_loop();
 
   return 0;
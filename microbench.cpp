@@ -0,0 +1,312 @@
+/* MICROBENCH.CPP: times the engine's primitives (move generation, make/undo,
+ * the attack maps, evaluation, the TT, slider lookups and FEN parsing) in
+ * ns per operation, so a regression shows up on the primitive that caused it.
+ *
+ * every benchmark runs over a corpus of positions: the bench positions and
+ * the positions of short random games from them (or the FENs of an EPD file).
+ * a sample is one pass over the corpus, and after some warm-up passes we take
+ * MICROBENCH_SAMPLES of them and report the median and the 99th percentile.
+ *
+ * usage: microbench.out [output file] [EPD file]. the results are also written
+ * to the output file (microbench.json by default), one benchmark per line, so
+ * the files of two builds can be diffed.
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "consts.h"
+#include "engine.h"
+#include "eval.h"
+#include "eval_params.h"
+#include "nnue.h"
+#include "tt.h"
+#include "utils.h"
+
+#define MICROBENCH_WARMUP 5 // passes over the corpus before we start timing
+#define MICROBENCH_SAMPLES 100 // timed passes per benchmark
+#define MICROBENCH_GAMES 8 // random games played from every bench position
+#define MICROBENCH_GAME_PLIES 24 // length of each random game
+#define MICROBENCH_MAX_EPD_POSITIONS 10000
+#define MICROBENCH_TT_KEYS (1 << 16) // TT operations per pass
+
+// the corpus, and (for FEN parsing) the FENs we have:
+static std::vector<board> corpus;
+static std::vector<std::string> fens;
+
+// results of the benchmarked calls are summed into this, so the compiler can't
+// drop them:
+static volatile U64 sink;
+
+struct microbench_result {
+  std::string name;
+  U64 ops; // operations per pass
+  double median_ns;
+  double p99_ns;
+};
+
+static std::vector<microbench_result> results;
+
+// invalidate_attacks(): make the board's next update_move_info_bitboards()
+// compute the attack maps, like it has to after a make_move() in the search:
+static inline void invalidate_attacks(board& b) {
+  if ((int) b.attack_cache.size() > b.ply) b.attack_cache[b.ply].key = 0;
+}
+
+// run(): time pass() (which returns the number of operations it did) and
+// record the median and 99th percentile of the ns per operation:
+template <typename F>
+static void run(const char* name, F pass) {
+  U64 ops = 0;
+  for (int i = 0; i < MICROBENCH_WARMUP; i++) ops = pass();
+
+  std::vector<double> samples;
+  for (int i = 0; i < MICROBENCH_SAMPLES; i++) {
+    auto start = steady_clock::now();
+    ops = pass();
+    auto end = steady_clock::now();
+    samples.push_back(duration_cast<nanoseconds>(end - start).count() / (double) std::max(ops, (U64) 1));
+  }
+
+  std::sort(samples.begin(), samples.end());
+  microbench_result result;
+  result.name = name;
+  result.ops = ops;
+  result.median_ns = samples[samples.size() / 2];
+  result.p99_ns = samples[std::min(samples.size() - 1, (size_t) (samples.size() * 0.99))];
+  results.push_back(result);
+  printf("%-28s %10llu %12.2f %12.2f\n", name, ops, result.median_ns, result.p99_ns);
+}
+
+// load_corpus(): the FENs of the EPD file (everything before the first quote,
+// or the whole line), or the bench positions and random games from them:
+static bool load_corpus(const char* epd_filename) {
+  if (epd_filename) {
+    std::ifstream ifs(epd_filename);
+    if (ifs.fail()) return false;
+    std::string line;
+    while (fens.size() < MICROBENCH_MAX_EPD_POSITIONS && std::getline(ifs, line)) {
+      std::string fen = line.substr(0, line.find('"'));
+      if (fen.find('/') != std::string::npos) fens.push_back(fen);
+    }
+    for (int i = 0; i < fens.size(); i++) corpus.push_back(board((char*) fens[i].c_str()));
+    return !corpus.empty();
+  }
+
+  std::mt19937 rng(1);
+  int move_list[MAX_POSITION_MOVES];
+  for (int i = 0; i < NUM_BENCH_FENS; i++) {
+    fens.push_back(BENCH_FENS[i]);
+    board root((char*) BENCH_FENS[i]);
+    corpus.push_back(root);
+    for (int game = 0; game < MICROBENCH_GAMES; game++) {
+      board b = root;
+      for (int ply = 0; ply < MICROBENCH_GAME_PLIES; ply++) {
+        int num_moves = b.get_moves(move_list);
+        if (!num_moves) break;
+        b.make_move(move_list[rng() % num_moves]);
+        corpus.push_back(b);
+      }
+    }
+  }
+  return true;
+}
+
+// write_results(): write the results as JSON, one benchmark per line:
+static bool write_results(const char* filename) {
+  FILE* f = fopen(filename, "w");
+  if (!f) return false;
+  fprintf(f, "{\n");
+  #if defined(USE_PEXT)
+    const char* sliders = "pext";
+  #else
+    const char* sliders = "magic";
+  #endif
+  fprintf(f, "  \"build\": {\"sliders\": \"%s\", \"nnue\": %s, \"positions\": %d, \"samples\": %d},\n",
+          sliders, nnue_network ? "true" : "false", (int) corpus.size(), MICROBENCH_SAMPLES);
+  for (int i = 0; i < results.size(); i++) {
+    const microbench_result& r = results[i];
+    fprintf(f, "  \"%s\": {\"ops\": %llu, \"median_ns\": %.2f, \"p99_ns\": %.2f}%s\n", r.name.c_str(),
+            r.ops, r.median_ns, r.p99_ns, i + 1 < results.size() ? "," : "");
+  }
+  fprintf(f, "}\n");
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  init_consts();
+  init_eval_params();
+  init_nnue();
+  init_globals();
+
+  const char* output_filename = (argc > 1) ? argv[1] : "microbench.json";
+  if (!load_corpus((argc > 2) ? argv[2] : NULL)) {
+    printf("error: can't read positions from %s.\n", argv[2]);
+    return 1;
+  }
+
+  printf("%d positions, %d samples per benchmark\n\n", (int) corpus.size(), MICROBENCH_SAMPLES);
+  printf("%-28s %10s %12s %12s\n", "benchmark", "ops/pass", "median ns", "p99 ns");
+
+  int move_list[MAX_POSITION_MOVES];
+
+  // move generation (with the attack maps, which the search computes once per
+  // node, so they're invalidated first):
+  run("get_moves", [&]() {
+    U64 ops = 0, sum = 0;
+    for (board& b : corpus) {
+      invalidate_attacks(b);
+      sum += b.get_moves(move_list);
+      ops++;
+    }
+    sink += sum;
+    return ops;
+  });
+
+  run("get_nonquiet_moves", [&]() {
+    U64 ops = 0, sum = 0;
+    for (board& b : corpus) {
+      invalidate_attacks(b);
+      sum += b.get_nonquiet_moves(move_list);
+      ops++;
+    }
+    sink += sum;
+    return ops;
+  });
+
+  // computing the attack maps (UNSAFE, the checkers and the pins):
+  run("update_move_info_bitboards", [&]() {
+    U64 ops = 0, sum = 0;
+    for (board& b : corpus) {
+      invalidate_attacks(b);
+      b.update_move_info_bitboards();
+      sum += b.UNSAFE;
+      ops++;
+    }
+    sink += sum;
+    return ops;
+  });
+
+  // make_move()/undo_move() pairs over every legal move of every position:
+  std::vector<std::vector<int> > legal_moves(corpus.size());
+  for (int i = 0; i < corpus.size(); i++) {
+    int num_moves = corpus[i].get_moves(move_list);
+    legal_moves[i].assign(move_list, move_list + num_moves);
+  }
+  run("make_move+undo_move", [&]() {
+    U64 ops = 0, sum = 0;
+    for (int i = 0; i < corpus.size(); i++) {
+      board& b = corpus[i];
+      for (int move : legal_moves[i]) {
+        b.make_move(move);
+        sum += b.hash;
+        b.undo_move();
+        ops++;
+      }
+    }
+    sink += sum;
+    return ops;
+  });
+
+  // the full static evaluation, and the one the search does (with the pawn
+  // and material caches):
+  run("evaluate", [&]() {
+    U64 ops = 0;
+    int sum = 0;
+    for (board& b : corpus) {
+      sum += evaluate(b);
+      ops++;
+    }
+    sink += sum;
+    return ops;
+  });
+
+  pawn_table pawns;
+  material_table materials;
+  run("evaluate_cached", [&]() {
+    U64 ops = 0;
+    int sum = 0;
+    for (board& b : corpus) {
+      sum += evaluate(b, &pawns, &materials);
+      ops++;
+    }
+    sink += sum;
+    return ops;
+  });
+
+  // slider attacks from every square with every position's occupancy:
+  run("line_moves_magic", [&]() {
+    U64 ops = 0, sum = 0;
+    for (board& b : corpus) {
+      U64 occupied = b.W | b.B;
+      for (int s = 0; s < 64; s++) sum ^= line_moves_magic(s, occupied);
+      ops += 64;
+    }
+    sink += sum;
+    return ops;
+  });
+
+  run("diag_moves_magic", [&]() {
+    U64 ops = 0, sum = 0;
+    for (board& b : corpus) {
+      U64 occupied = b.W | b.B;
+      for (int s = 0; s < 64; s++) sum ^= diag_moves_magic(s, occupied);
+      ops += 64;
+    }
+    sink += sum;
+    return ops;
+  });
+
+  // TT writes and reads of random keys, at sizes from cache-resident to much
+  // bigger than the caches:
+  std::vector<U64> keys(MICROBENCH_TT_KEYS);
+  std::mt19937_64 rng(1);
+  for (U64& key : keys) key = rng();
+  int tt_sizes[] = {1, 16, 256};
+  for (int size : tt_sizes) {
+    transposition_table table(size);
+    std::string name = "tt_put_" + std::to_string(size) + "mb";
+    run(name.c_str(), [&]() {
+      for (int i = 0; i < keys.size(); i++) {
+        table.put(keys[i], i & 31, i & 1023, i & 511, i & 0xFFFF, TT_EXACT, i & 1);
+      }
+      return (U64) keys.size();
+    });
+
+    name = "tt_probe_" + std::to_string(size) + "mb";
+    run(name.c_str(), [&]() {
+      int sum = 0;
+      for (int i = 0; i < keys.size(); i++) sum += table.probe(keys[i], i & 31, -1000, 1000);
+      sink += sum;
+      return (U64) keys.size();
+    });
+  }
+
+  // (with only the bench FENs, a pass parses them several times, so it takes
+  // long enough to time):
+  run("fen_parsing", [&]() {
+    U64 ops = 0, sum = 0;
+    while (ops < 1000) {
+      for (int i = 0; i < fens.size(); i++) {
+        board b((char*) fens[i].c_str());
+        sum += b.hash;
+        ops++;
+      }
+    }
+    sink += sum;
+    return ops;
+  });
+
+  if (!write_results(output_filename)) {
+    printf("error: can't write %s.\n", output_filename);
+    return 1;
+  }
+  printf("\nresults written to %s\n", output_filename);
+  return 0;
+}
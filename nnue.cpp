@@ -0,0 +1,303 @@
+#include <fstream>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+#include "board.h"
+#include "nnue.h"
+
+// the network embedded with 'make NNUE=<file>':
+#ifdef NNUE_EMBEDDED_FILE
+asm(
+  "  .section .rodata\n"
+  "  .balign 64\n"
+  "  .global embedded_nnue_begin\n"
+  "embedded_nnue_begin:\n"
+  "  .incbin \"" NNUE_EMBEDDED_FILE "\"\n"
+  "  .global embedded_nnue_end\n"
+  "embedded_nnue_end:\n"
+  "  .previous\n"
+);
+extern "C" const char embedded_nnue_begin[];
+extern "C" const char embedded_nnue_end[];
+#endif
+
+int nnue_network = 0;
+
+// the id the next loaded network gets:
+static int next_network = 1;
+
+// the network weights. the int8 layers are stored row by row ([output][input]):
+static int16_t ft_biases[NNUE_HALF_DIMENSIONS];
+alignas(64) static int16_t ft_weights[NNUE_INPUT_DIMENSIONS * NNUE_HALF_DIMENSIONS];
+static int32_t l1_biases[NNUE_HIDDEN_DIMENSIONS];
+alignas(64) static int8_t l1_weights[NNUE_HIDDEN_DIMENSIONS * 2 * NNUE_HALF_DIMENSIONS];
+static int32_t l2_biases[NNUE_HIDDEN_DIMENSIONS];
+alignas(64) static int8_t l2_weights[NNUE_HIDDEN_DIMENSIONS * NNUE_HIDDEN_DIMENSIONS];
+static int32_t output_bias;
+alignas(64) static int8_t output_weights[NNUE_HIDDEN_DIMENSIONS];
+
+// memory_buffer: a stream buffer over a block of memory (the embedded network):
+struct memory_buffer : std::streambuf {
+  memory_buffer(const char* begin, const char* end) {
+    setg((char*) begin, (char*) begin, (char*) end);
+  }
+};
+
+void init_nnue() {
+#ifdef NNUE_EMBEDDED_FILE
+  nnue_load_file(NNUE_EMBEDDED_NAME);
+#endif
+}
+
+// read(): read n little-endian values from the stream:
+template <typename T>
+static bool read(std::istream& in, T* values, int n) {
+  return (bool) in.read((char*) values, sizeof(T) * n);
+}
+
+bool nnue_load(std::istream& in) {
+  nnue_network = 0;
+
+  // the header: version, network hash and a description:
+  uint32_t version, hash, description_size;
+  if (!read(in, &version, 1) || version != NNUE_VERSION) return false;
+  if (!read(in, &hash, 1) || !read(in, &description_size, 1)) return false;
+  in.ignore(description_size);
+
+  // the feature transformer (the first layer):
+  if (!read(in, &hash, 1)) return false;
+  if (!read(in, ft_biases, NNUE_HALF_DIMENSIONS)) return false;
+  if (!read(in, ft_weights, NNUE_INPUT_DIMENSIONS * NNUE_HALF_DIMENSIONS)) return false;
+
+  // the hidden layers and the output layer:
+  if (!read(in, &hash, 1)) return false;
+  if (!read(in, l1_biases, NNUE_HIDDEN_DIMENSIONS)) return false;
+  if (!read(in, l1_weights, NNUE_HIDDEN_DIMENSIONS * 2 * NNUE_HALF_DIMENSIONS)) return false;
+  if (!read(in, l2_biases, NNUE_HIDDEN_DIMENSIONS)) return false;
+  if (!read(in, l2_weights, NNUE_HIDDEN_DIMENSIONS * NNUE_HIDDEN_DIMENSIONS)) return false;
+  if (!read(in, &output_bias, 1)) return false;
+  if (!read(in, output_weights, NNUE_HIDDEN_DIMENSIONS)) return false;
+
+  // the network has to end here (otherwise it has a different architecture):
+  if (in.peek() != EOF) return false;
+
+  nnue_network = next_network++;
+  return true;
+}
+
+bool nnue_load_file(const char* filename) {
+  if (!strcmp(filename, NNUE_EMBEDDED_NAME)) {
+#ifdef NNUE_EMBEDDED_FILE
+    memory_buffer buffer(embedded_nnue_begin, embedded_nnue_end);
+    std::istream in(&buffer);
+    return nnue_load(in);
+#else
+    nnue_network = 0;
+    return false;
+#endif
+  }
+
+  std::ifstream in(filename, std::ios::binary);
+  return nnue_load(in);
+}
+
+void nnue_unload() {
+  nnue_network = 0;
+}
+
+// feature_index(): the HalfKP input for a non-king piece on a square, seen from
+// the given perspective with its king on king_square. the network's squares go
+// A1..H8 from that side's point of view, so for white we flip the ranks of our
+// A8..H1 squares, and for black we flip the files:
+static inline int feature_index(int perspective, int king_square, int piece, int square) {
+  int flip = perspective ? 7 : 56;
+  bool own = (piece >= BLACK) == (perspective == 1);
+  return (square ^ flip) + 1 + (piece % 6) * 128 + (own ? 0 : 64) + 641 * (king_square ^ flip);
+}
+
+// add_feature(), sub_feature(): add or remove a feature's weights (the
+// compiler vectorizes these loops):
+static inline void add_feature(int16_t* values, int index) {
+  const int16_t* weights = &ft_weights[index * NNUE_HALF_DIMENSIONS];
+  for (int i = 0; i < NNUE_HALF_DIMENSIONS; i++) values[i] += weights[i];
+}
+
+static inline void sub_feature(int16_t* values, int index) {
+  const int16_t* weights = &ft_weights[index * NNUE_HALF_DIMENSIONS];
+  for (int i = 0; i < NNUE_HALF_DIMENSIONS; i++) values[i] -= weights[i];
+}
+
+void nnue_refresh(board& b, int perspective) {
+  if ((int) b.accumulators.size() <= b.ply) b.accumulators.resize(b.ply + 1);
+  nnue_accumulator& acc = b.accumulators[b.ply];
+  int16_t* values = acc.values[perspective];
+  U64 king = b.bitboard[perspective ? BK : WK];
+  int king_square = LSB(king);
+
+  memcpy(values, ft_biases, sizeof(ft_biases));
+  for (int piece = WP; piece < NONE; piece++) {
+    if (piece == WK || piece == BK) continue;
+    U64 pieces = b.bitboard[piece];
+    while (pieces) {
+      add_feature(values, feature_index(perspective, king_square, piece, LSB(pieces)));
+      POP_LSB(pieces);
+    }
+  }
+
+  acc.computed[perspective] = nnue_network;
+}
+
+void nnue_update(board& b, int move, int piece_moved) {
+  if ((int) b.accumulators.size() <= b.ply) b.accumulators.resize(b.ply + 1);
+  nnue_accumulator& parent = b.accumulators[b.ply - 1];
+  nnue_accumulator& child = b.accumulators[b.ply];
+
+  // collect the pieces that left and arrived on squares (kings aren't inputs):
+  int to = MOVE_TO(move);
+  int from = MOVE_FROM(move);
+  int captured = MOVE_CAPTURED(move);
+  int removed[3][2], added[2][2];
+  int num_removed = 0, num_added = 0;
+
+  if (piece_moved != WK && piece_moved != BK) {
+    removed[num_removed][0] = piece_moved;
+    removed[num_removed++][1] = from;
+    added[num_added][0] = MOVE_IS_PROMOTION(move) ? MOVE_PROMOTION_PIECE(move) : piece_moved;
+    added[num_added++][1] = to;
+  }
+  if (captured != NONE) {
+    removed[num_removed][0] = captured;
+    removed[num_removed++][1] = MOVE_IS_EP(move) ? (from & ~7) | (to & 7) : to;
+  }
+  if (MOVE_IS_CASTLE(move)) {
+    int rook = (piece_moved == WK) ? WR : BR;
+    removed[num_removed][0] = rook;
+    removed[num_removed++][1] = (to & 7) == G ? to + 1 : to - 2;
+    added[num_added][0] = rook;
+    added[num_added++][1] = (to & 7) == G ? to - 1 : to + 1;
+  }
+
+  for (int perspective = 0; perspective < 2; perspective++) {
+    // if this side's king moved, all of its inputs changed:
+    int king = perspective ? BK : WK;
+    if (piece_moved == king || parent.computed[perspective] != nnue_network) {
+      nnue_refresh(b, perspective);
+      continue;
+    }
+
+    int king_square = LSB(b.bitboard[king]);
+    int16_t* values = child.values[perspective];
+    memcpy(values, parent.values[perspective], sizeof(child.values[perspective]));
+    for (int i = 0; i < num_removed; i++) {
+      sub_feature(values, feature_index(perspective, king_square, removed[i][0], removed[i][1]));
+    }
+    for (int i = 0; i < num_added; i++) {
+      add_feature(values, feature_index(perspective, king_square, added[i][0], added[i][1]));
+    }
+    child.computed[perspective] = nnue_network;
+  }
+}
+
+// affine_scalar(): output = biases + weights * input, without SIMD:
+static void affine_scalar(const uint8_t* input, const int8_t* weights, const int32_t* biases,
+                          int32_t* output, int inputs, int outputs) {
+  for (int i = 0; i < outputs; i++) {
+    const int8_t* row = weights + i * inputs;
+    int32_t sum = biases[i];
+    for (int j = 0; j < inputs; j++) sum += input[j] * row[j];
+    output[i] = sum;
+  }
+}
+
+// affine(): output = biases + weights * input, for a layer with the given
+// number of inputs (a multiple of 32) and outputs. inputs are at most 127 and
+// weights at least -128, so the pairwise int16 sums of maddubs can't saturate,
+// and all kernels give exactly the same results as affine_scalar():
+static void affine(const uint8_t* input, const int8_t* weights, const int32_t* biases,
+                   int32_t* output, int inputs, int outputs) {
+#if defined(__AVX2__)
+  const __m256i ones = _mm256_set1_epi16(1);
+  for (int i = 0; i < outputs; i++) {
+    const int8_t* row = weights + i * inputs;
+    __m256i sum = _mm256_setzero_si256();
+    for (int j = 0; j < inputs; j += 32) {
+      __m256i products = _mm256_maddubs_epi16(
+        _mm256_loadu_si256((const __m256i*) (input + j)),
+        _mm256_load_si256((const __m256i*) (row + j))
+      );
+      sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+    }
+    __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0x4E));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0xB1));
+    output[i] = biases[i] + _mm_cvtsi128_si32(sum128);
+  }
+#elif defined(__SSE4_1__)
+  const __m128i ones = _mm_set1_epi16(1);
+  for (int i = 0; i < outputs; i++) {
+    const int8_t* row = weights + i * inputs;
+    __m128i sum = _mm_setzero_si128();
+    for (int j = 0; j < inputs; j += 16) {
+      __m128i products = _mm_maddubs_epi16(
+        _mm_loadu_si128((const __m128i*) (input + j)),
+        _mm_load_si128((const __m128i*) (row + j))
+      );
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(products, ones));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    output[i] = biases[i] + _mm_cvtsi128_si32(sum);
+  }
+#else
+  affine_scalar(input, weights, biases, output, inputs, outputs);
+#endif
+}
+
+// clipped_relu(): scale a layer's outputs back down and clamp them to [0, 127]:
+static inline void clipped_relu(const int32_t* input, uint8_t* output, int n) {
+  for (int i = 0; i < n; i++) output[i] = std::min(std::max(input[i] >> 6, 0), 127);
+}
+
+// evaluate_network(): the network's evaluation, with the SIMD kernels or (if
+// SCALAR) with affine_scalar():
+template <bool SCALAR>
+static int evaluate_network(board& b) {
+  // make sure the accumulator is up to date:
+  if ((int) b.accumulators.size() <= b.ply) b.accumulators.resize(b.ply + 1);
+  for (int perspective = 0; perspective < 2; perspective++) {
+    if (b.accumulators[b.ply].computed[perspective] != nnue_network) nnue_refresh(b, perspective);
+  }
+  nnue_accumulator& acc = b.accumulators[b.ply];
+
+  // the side to move's half comes first:
+  alignas(64) uint8_t input[2 * NNUE_HALF_DIMENSIONS];
+  int us = (b.turn == WHITE) ? 0 : 1;
+  for (int i = 0; i < NNUE_HALF_DIMENSIONS; i++) {
+    input[i] = std::min(std::max((int) acc.values[us][i], 0), 127);
+    input[NNUE_HALF_DIMENSIONS + i] = std::min(std::max((int) acc.values[us ^ 1][i], 0), 127);
+  }
+
+  alignas(64) int32_t sums[NNUE_HIDDEN_DIMENSIONS];
+  alignas(64) uint8_t hidden1[NNUE_HIDDEN_DIMENSIONS];
+  alignas(64) uint8_t hidden2[NNUE_HIDDEN_DIMENSIONS];
+  auto layer = SCALAR ? affine_scalar : affine;
+  layer(input, l1_weights, l1_biases, sums, 2 * NNUE_HALF_DIMENSIONS, NNUE_HIDDEN_DIMENSIONS);
+  clipped_relu(sums, hidden1, NNUE_HIDDEN_DIMENSIONS);
+  layer(hidden1, l2_weights, l2_biases, sums, NNUE_HIDDEN_DIMENSIONS, NNUE_HIDDEN_DIMENSIONS);
+  clipped_relu(sums, hidden2, NNUE_HIDDEN_DIMENSIONS);
+  int32_t output;
+  layer(hidden2, output_weights, &output_bias, &output, NNUE_HIDDEN_DIMENSIONS, 1);
+
+  // the output is in 1/16ths of stockfish's internal units (a pawn is 208):
+  return output * 100 / (16 * 208);
+}
+
+int nnue_evaluate(board& b) {
+  return evaluate_network<false>(b);
+}
+
+int nnue_evaluate_scalar(board& b) {
+  return evaluate_network<true>(b);
+}
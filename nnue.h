@@ -0,0 +1,71 @@
+/* NNUE.H: an efficiently updatable neural network evaluation. luna reads
+ * networks in the stockfish 12 format: HalfKP inputs (the king square of the
+ * perspective side times every non-king piece on every square), a 256-wide
+ * int16 first layer for each perspective, two 32-wide int8 hidden layers and
+ * a single output.
+ *
+ * the first layer (the accumulator) is the only expensive part, and it only
+ * changes by a few weights per move, so make_move() updates it incrementally
+ * instead of recomputing it. without a network, luna uses the hand-crafted
+ * evaluation.
+*/
+
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <istream>
+#include <stdint.h>
+
+#include "defs.h"
+
+#define NNUE_VERSION 0x7AF32F16
+#define NNUE_HALF_DIMENSIONS 256
+#define NNUE_INPUT_DIMENSIONS 41024 // 64 king squares * 641 piece-squares
+#define NNUE_HIDDEN_DIMENSIONS 32
+
+// the EvalFile value that refers to the network embedded in the binary (build
+// with 'make NNUE=<file>'):
+#define NNUE_EMBEDDED_NAME "<embedded>"
+
+struct board;
+
+// nnue_accumulator: the first layer outputs of one position for both
+// perspectives ([0] = white's, [1] = black's). each half is only valid if
+// computed[] holds the id of the loaded network:
+struct nnue_accumulator {
+  int16_t values[2][NNUE_HALF_DIMENSIONS];
+  int computed[2];
+};
+
+// the id of the loaded network (every load gets a new one, so accumulators
+// computed with an older network are never used), or 0 if there is none:
+extern int nnue_network;
+
+// init_nnue(): load the embedded network, if there is one:
+void init_nnue();
+
+// nnue_load(): read a network from the stream. on failure, no network is loaded:
+bool nnue_load(std::istream& in);
+
+// nnue_load_file(): read a network from a file (or NNUE_EMBEDDED_NAME):
+bool nnue_load_file(const char* filename);
+
+// nnue_unload(): go back to the hand-crafted evaluation:
+void nnue_unload();
+
+// nnue_refresh(): recompute one perspective of the board's current accumulator
+// from scratch:
+void nnue_refresh(board& b, int perspective);
+
+// nnue_update(): compute the accumulator after the given move (called at the
+// end of make_move()) from the accumulator before it:
+void nnue_update(board& b, int move, int piece_moved);
+
+// nnue_evaluate(): the network's evaluation (relative to the side to move):
+int nnue_evaluate(board& b);
+
+// nnue_evaluate_scalar(): the same evaluation without the SIMD kernels (for
+// testing them):
+int nnue_evaluate_scalar(board& b);
+
+#endif
@@ -0,0 +1,174 @@
+#include "packed.h"
+
+#include <fstream>
+#include <string>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+bool pack_position(board& b, int result, packed_position& p) {
+  memset(&p, 0, sizeof(packed_position));
+  p.occupied = b.W | b.B;
+  if (POPCOUNT(p.occupied) > 32) return false;
+
+  // the pieces, one nibble each, in the order of their squares:
+  U64 occupied = p.occupied;
+  for (int i = 0; occupied; i++) {
+    int square = LSB(occupied);
+    p.pieces[i / 2] |= b.piece_board[square] << (4 * (i % 2));
+    POP_LSB(occupied);
+  }
+
+  p.turn = b.turn;
+  p.castle_rights = b.castle_rights;
+  p.fifty_move_counter = std::min(b.fifty_move_counter, 255);
+  p.result = result;
+  return true;
+}
+
+void unpack_position(const packed_position& p, board& b) {
+  memset(b.bitboard, 0, 12 * sizeof(U64));
+  memset(b.piece_board, NONE, 64 * sizeof(char));
+  b.turn = p.turn;
+  b.castle_rights = p.castle_rights;
+  b.fifty_move_counter = p.fifty_move_counter;
+  b.ply = 0;
+  b.base_score = 0;
+  b.game_phase_score = 0;
+  b.material_key = 0;
+  b.hash = ZOBRIST_CASTLE_RIGHTS_KEYS[b.castle_rights] ^ (b.turn == WHITE ? ZOBRIST_TURN_KEY : 0);
+  b.pawn_hash = 0;
+
+  U64 occupied = p.occupied;
+  for (int i = 0; occupied; i++) {
+    int square = LSB(occupied);
+    int piece = (p.pieces[i / 2] >> (4 * (i % 2))) & 0xF;
+    b.bitboard[piece] |= (1L << square);
+    b.piece_board[square] = piece;
+    b.base_score += PIECE_SQUARE_SCORE[piece][square];
+    b.game_phase_score += GAME_PHASE_MATERIAL_SCORE[piece];
+    b.material_key += MATERIAL_KEY(piece);
+    b.hash ^= ZOBRIST_SQUARE_KEYS[piece][square];
+    if (piece == WP || piece == BP) b.pawn_hash ^= ZOBRIST_SQUARE_KEYS[piece][square];
+    POP_LSB(occupied);
+  }
+
+  b.W = b.bitboard[WP] | b.bitboard[WN] | b.bitboard[WB] | b.bitboard[WR] |
+        b.bitboard[WQ] | b.bitboard[WK];
+  b.B = b.bitboard[BP] | b.bitboard[BN] | b.bitboard[BB] | b.bitboard[BR] |
+        b.bitboard[BQ] | b.bitboard[BK];
+  b.OCCUPIED_SQUARES = b.W | b.B;
+  b.EMPTY_SQUARES = ~b.OCCUPIED_SQUARES;
+}
+
+bool parse_epd_line(const char* line, packed_position& p) {
+  // the FEN is everything before the quoted result:
+  const char* quote = strchr(line, '"');
+  if (!quote || quote - line >= 128) return false;
+
+  int result;
+  if (strstr(quote, "1-0")) result = PACKED_WHITE_WIN;
+  else if (strstr(quote, "1/2")) result = PACKED_DRAW;
+  else if (strstr(quote, "0-1")) result = PACKED_BLACK_WIN;
+  else return false;
+
+  char fen[128];
+  memcpy(fen, line, quote - line);
+  fen[quote - line] = '\0';
+  board b(fen);
+  return pack_position(b, result, p);
+}
+
+long pack_epd_file(const char* epd_filename, const char* packed_filename) {
+  std::ifstream ifs(epd_filename);
+  std::ofstream ofs(packed_filename, std::ios::binary);
+  if (ifs.fail() || ofs.fail()) return -1;
+
+  long count = 0;
+  std::string line;
+  packed_position p;
+  while (std::getline(ifs, line)) {
+    if (!parse_epd_line(line.c_str(), p)) continue;
+    ofs.write((const char*) &p, sizeof(packed_position));
+    count++;
+  }
+
+  return ofs.fail() ? -1 : count;
+}
+
+bool packed_file::open(const char* filename) {
+  close();
+
+#if defined(_WIN32) || defined(_WIN64)
+  // no mmap() on windows, so read the whole file:
+  std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+  if (ifs.fail()) return false;
+  buffer.resize((size_t) ifs.tellg() / sizeof(packed_position));
+  ifs.seekg(0);
+  ifs.read((char*) buffer.data(), buffer.size() * sizeof(packed_position));
+  positions = buffer.data();
+  count = buffer.size();
+  return !ifs.fail();
+#else
+  int fd = ::open(filename, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    ::close(fd);
+    return false;
+  }
+
+  count = st.st_size / sizeof(packed_position);
+  if (count) {
+    map_size = count * sizeof(packed_position);
+    map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      map = NULL;
+      count = 0;
+      ::close(fd);
+      return false;
+    }
+
+    // the kernel can read ahead, and drop pages we're done with:
+    madvise(map, map_size, MADV_SEQUENTIAL);
+    positions = (const packed_position*) map;
+  }
+
+  // (the mapping stays valid without the file descriptor)
+  ::close(fd);
+  return true;
+#endif
+}
+
+bool packed_file::load_epd(const char* filename, size_t max_positions) {
+  close();
+
+  std::ifstream ifs(filename);
+  if (ifs.fail()) return false;
+
+  std::string line;
+  packed_position p;
+  while (buffer.size() < max_positions && std::getline(ifs, line)) {
+    if (parse_epd_line(line.c_str(), p)) buffer.push_back(p);
+  }
+
+  positions = buffer.data();
+  count = buffer.size();
+  return true;
+}
+
+void packed_file::close() {
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (map) munmap(map, map_size);
+#endif
+  std::vector<packed_position>().swap(buffer);
+  map = NULL;
+  map_size = 0;
+  positions = NULL;
+  count = 0;
+}
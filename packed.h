@@ -0,0 +1,84 @@
+/* PACKED.H: a compact binary format for labeled positions. every position is
+ * a 32 byte record: the occupancy bitboard, then one nibble per occupied square
+ * (in square order) holding its piece, then the side to move, the castle rights,
+ * the fifty move counter and the game result. a file of packed positions is
+ * just an array of records, so it can be memory mapped and read with no parsing
+ * at all, and iterating over one only keeps the pages in use in memory.
+*/
+
+#ifndef PACKED_H
+#define PACKED_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "board.h"
+#include "defs.h"
+
+// game results, from white's point of view:
+#define PACKED_BLACK_WIN 0
+#define PACKED_DRAW 1
+#define PACKED_WHITE_WIN 2
+
+struct packed_position {
+  U64 occupied;
+  uint8_t pieces[16]; // the piece on the i-th occupied square is in nibble i
+  uint8_t turn;
+  uint8_t castle_rights;
+  uint8_t fifty_move_counter;
+  uint8_t result; // PACKED_BLACK_WIN, PACKED_DRAW or PACKED_WHITE_WIN
+  uint8_t padding[4];
+};
+
+static_assert(sizeof(packed_position) == 32, "packed positions must be 32 bytes");
+
+// pack_position(): pack the board (fails if it has more than 32 pieces):
+bool pack_position(board& b, int result, packed_position& p);
+
+// unpack_position(): set up the board from a packed position, like the FEN
+// constructor would, without allocating anything. (the move generation
+// bitboards aren't updated, call board::update_move_info_bitboards() for that.)
+void unpack_position(const packed_position& p, board& b);
+
+// packed_result(): the result as a score for white (1, 0.5 or 0):
+inline double packed_result(const packed_position& p) { return p.result / 2.0; }
+
+// parse_epd_line(): pack a line like 'FEN c9 "1-0";' (false if it has no result):
+bool parse_epd_line(const char* line, packed_position& p);
+
+// pack_epd_file(): convert an EPD file to a packed file, one line at a time.
+// returns the number of positions written, or -1 if a file can't be opened:
+long pack_epd_file(const char* epd_filename, const char* packed_filename);
+
+/* packed_file: a read-only array of packed positions, either memory mapped
+ * from a packed file or parsed from an EPD file into memory.
+*/
+struct packed_file {
+  const packed_position* positions;
+  size_t count;
+
+  packed_file() : positions(NULL), count(0), map(NULL), map_size(0) {}
+  ~packed_file() { close(); }
+
+  // open(): map a packed file (read sequentially, see madvise()):
+  bool open(const char* filename);
+
+  // load_epd(): parse up to max_positions positions from an EPD file:
+  bool load_epd(const char* filename, size_t max_positions);
+
+  // close(): unmap or free the positions:
+  void close();
+
+  size_t size() const { return count; }
+  const packed_position& operator[](size_t i) const { return positions[i]; }
+
+private:
+  std::vector<packed_position> buffer; // the positions of an EPD file
+  void* map;
+  size_t map_size;
+
+  packed_file(const packed_file&);
+  packed_file& operator=(const packed_file&);
+};
+
+#endif
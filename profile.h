@@ -0,0 +1,85 @@
+/* PROFILE.H: a cycle-level profiler for the hot paths of the search. in builds
+ * with -DHOT_PROFILE ('make PROFILE=1'), PROFILE(section) starts a timer that
+ * adds the cycles (read with rdtsc) until the end of its scope, and a call, to
+ * the section's counter. in other builds PROFILE() compiles to nothing.
+ *
+ * every search thread registers its own counters (see thread_profile()), so the
+ * timers never write to memory another thread uses. calls on threads that
+ * didn't register any counters aren't counted. sections nest (get_moves() calls
+ * the move info update and get_captures(), for example), so every section's
+ * time includes the time of the sections it calls.
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+
+#include "defs.h"
+
+// the profiled sections:
+enum {
+  PROFILE_GET_MOVES, PROFILE_GET_CAPTURES, PROFILE_GET_QUIETS, PROFILE_MAKE_MOVE,
+  PROFILE_UNDO_MOVE, PROFILE_MOVE_INFO, PROFILE_EVALUATE, PROFILE_TT_PROBE,
+  PROFILE_SCORE_MOVES, PROFILE_PICK_BEST, NUM_PROFILE_SECTIONS
+};
+
+// profile_section_name(): the name of a section in the profile table:
+inline const char* profile_section_name(int section) {
+  static const char* names[NUM_PROFILE_SECTIONS] = {
+    "get_moves", "get_captures", "get_quiets", "make_move", "undo_move",
+    "move_info", "evaluate", "tt_probe", "score_moves", "pick_best"
+  };
+  return names[section];
+}
+
+struct profile_counter {
+  U64 cycles;
+  U64 calls;
+};
+
+// thread_profile(): the calling thread's counters (NUM_PROFILE_SECTIONS of
+// them), or NULL if it doesn't profile:
+inline profile_counter*& thread_profile() {
+  static thread_local profile_counter* counters = NULL;
+  return counters;
+}
+
+// profile_clock(): the time stamp counter (in nanoseconds where there is none):
+inline U64 profile_clock() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// profile_timer: counts the cycles from its construction to its destruction:
+struct profile_timer {
+  profile_counter* counter;
+  U64 start;
+
+  profile_timer(int section) :
+    counter(thread_profile() ? thread_profile() + section : NULL), start(profile_clock()) {}
+
+  ~profile_timer() {
+    if (!counter) return;
+    counter->cycles += profile_clock() - start;
+    counter->calls++;
+  }
+};
+
+#ifdef HOT_PROFILE
+  #define PROFILE_TIMER_NAME(line) profile_timer_##line
+  #define PROFILE_TIMER(section, line) profile_timer PROFILE_TIMER_NAME(line)(section)
+  #define PROFILE(section) PROFILE_TIMER(section, __LINE__)
+#else
+  #define PROFILE(section)
+#endif
+
+#endif
@@ -1,8 +1,15 @@
+#include <atomic>
+#include <fstream>
+#include <random>
+#include <sstream>
 #include <stdio.h>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "board.h"
+#include "packed.h"
+#include "tt.h"
 #include "utils.h"
 
 #define GREEN  "\033[32m"
@@ -10,9 +17,16 @@
 #define YELLOW "\033[33m"
 #define RESET  "\033[0m"
 
-long perft(board* b, int depth);
 long perft_verify(board* b, int depth);
+long perft_key_after(board* b, int depth);
+long perft_staged(board* b, int depth);
+long perft_nnue(board* b, int depth);
+long perft_attacks(board* b, int depth);
+long perft_packed(board* b, int depth);
 bool verify(board* b);
+bool tt_stress_test(int num_threads, int operations_per_thread);
+bool nnue_test();
+bool packed_file_test();
 void print_move(int m);
 
 struct perft_test {
@@ -27,8 +41,25 @@ struct perft_test {
     board b(FEN);
     printf("starting test: %s\n", test_name);
     verify(&b);
+    if (perft_key_after(&b, 3)) {
+      printf("%s %sFAILED%s: key_after() or the pawn hash differs from make_move()\n", test_name, RED, RESET);
+      return false;
+    }
+    if (perft_attacks(&b, 3)) {
+      printf("%s %sFAILED%s: cached attack maps differ from the position's attacks\n", test_name, RED, RESET);
+      return false;
+    }
+    if (perft_packed(&b, 3)) {
+      printf("%s %sFAILED%s: unpacked positions differ from the packed ones\n", test_name, RED, RESET);
+      return false;
+    }
+    if (perft_staged(&b, 3)) {
+      printf("%s %sFAILED%s: staged move generation differs from get_moves()\n", test_name, RED, RESET);
+      return false;
+    }
+    int threads = std::max(1, (int) std::thread::hardware_concurrency());
     for (int i = 1; i < results.size(); i++) {
-      if (perft(&b, i) != results[i]) {
+      if (perft(b, i, threads, false) != results[i]) {
         printf("%s %sFAILED%s at depth %d\n", test_name, RED, RESET, i);
         return false;
       }
@@ -88,6 +119,9 @@ int main() {
   // run all tests:
   int start_time = get_time();
   bool all_tests_passed = true;
+  all_tests_passed &= tt_stress_test(8, 2000000);
+  all_tests_passed &= nnue_test();
+  all_tests_passed &= packed_file_test();
   all_tests_passed &= initial_position.test();
   all_tests_passed &= pt2.test();
   all_tests_passed &= pt3.test();
@@ -102,39 +136,156 @@ int main() {
   printf("test took %.4f seconds\n", (time_ms / 1000.0));
 }
 
-// perft(): the perft test function
-long perft(board* b, int depth) {
+// perft_verify(): perft testing using the verify() method
+long perft_verify(board* b, int depth) {
+  if (depth == 0) {
+    verify(b);
+    return 1;
+  }
   int moves[MAX_POSITION_MOVES];
   int num_moves = b->get_moves(moves);
-  if (depth == 1) return num_moves;
 
   long sum = 0;
   for (int i = 0; i < num_moves; i++) {
     b->make_move(moves[i]);
-    sum += perft(b, depth - 1);
+    sum += perft_verify(b, depth - 1);
     b->undo_move();
   }
 
   return sum;
 }
 
-// perft_verify(): perft testing using the verify() method
-long perft_verify(board* b, int depth) {
-  if (depth == 0) {
-    verify(b);
-    return 1;
+// pawn_key(): the pawn hash, computed from scratch:
+U64 pawn_key(board* b) {
+  U64 key = 0L;
+  for (int sq = 0; sq < 64; sq++) {
+    if (b->piece_board[sq] == WP || b->piece_board[sq] == BP) key ^= ZOBRIST_SQUARE_KEYS[b->piece_board[sq]][sq];
   }
+  return key;
+}
+
+// perft_key_after(): counts the moves (up to the given depth) for which
+// key_after() doesn't predict the hash make_move() ends up with, or for which
+// the incrementally updated pawn hash is wrong:
+long perft_key_after(board* b, int depth) {
+  if (depth == 0) return 0;
   int moves[MAX_POSITION_MOVES];
   int num_moves = b->get_moves(moves);
 
-  long sum = 0;
+  long errors = 0;
   for (int i = 0; i < num_moves; i++) {
+    U64 key = b->key_after(moves[i]);
     b->make_move(moves[i]);
-    sum += perft_verify(b, depth - 1);
+    if (key != b->hash) errors++;
+    if (pawn_key(b) != b->pawn_hash) errors++;
+    errors += perft_key_after(b, depth - 1);
     b->undo_move();
+    if (pawn_key(b) != b->pawn_hash) errors++;
   }
 
-  return sum;
+  return errors;
+}
+
+// perft_staged(): counts the positions (up to the given depth) in which the
+// staged move generation functions used by the move picker disagree with
+// get_moves(). get_captures() + get_quiets() must generate every legal move
+// once, none of the moves may leave the king in check, and near the root,
+// move_from_short() must find exactly the legal moves for every short move
+// there is:
+long perft_staged(board* b, int depth) {
+  static int expected[1 << 15];
+  int moves[MAX_POSITION_MOVES];
+  int num_moves = b->get_moves(moves);
+  long errors = 0;
+
+  int staged[MAX_POSITION_MOVES];
+  b->update_move_info_bitboards();
+  int num_staged = b->get_captures(staged);
+  num_staged += b->get_quiets(staged + num_staged);
+
+  // every legal move must be generated exactly once:
+  if (num_staged != num_moves) errors++;
+  for (int i = 0; i < num_moves; i++) {
+    int count = 0;
+    for (int j = 0; j < num_staged; j++) count += (staged[j] == moves[i]);
+    if (count != 1) errors++;
+  }
+
+  // and no move may leave our king attacked:
+  for (int i = 0; i < num_moves; i++) {
+    int us = b->turn;
+    b->make_move(moves[i]);
+    U64 king = b->bitboard[KING + us];
+    U64 them = (us == WHITE) ? b->B : b->W;
+    if (b->get_attackers(b->W | b->B, LSB(king)) & them) errors++;
+    b->undo_move();
+  }
+
+  // move_from_short() has to agree with the legal moves:
+  if (depth >= 2) {
+    b->update_move_info_bitboards();
+    for (int j = 0; j < num_moves; j++) expected[MOVE_SHORT(moves[j])] = moves[j];
+    for (int short_move = 0; short_move < (1 << 15); short_move++) {
+      if (b->move_from_short(short_move) != expected[short_move]) errors++;
+    }
+    for (int j = 0; j < num_moves; j++) expected[MOVE_SHORT(moves[j])] = NULL;
+  }
+
+  if (depth == 1) return errors;
+  for (int i = 0; i < num_moves; i++) {
+    b->make_move(moves[i]);
+    errors += perft_staged(b, depth - 1);
+    b->undo_move();
+  }
+
+  return errors;
+}
+
+// perft_attacks(): counts the positions (up to the given depth) in which the
+// cached attack maps (fetched after the moves below were made and undone) are
+// wrong: every square has to be attacked in the maps exactly if get_attackers()
+// finds an attacker, and the checkers and pins must match a fresh computation:
+long perft_attacks(board* b, int depth) {
+  int moves[MAX_POSITION_MOVES];
+  int num_moves = b->get_moves(moves);
+  long errors = 0;
+
+  if (depth > 1) {
+    for (int i = 0; i < num_moves; i++) {
+      b->make_move(moves[i]);
+      errors += perft_attacks(b, depth - 1);
+      b->undo_move();
+    }
+  }
+
+  const attack_info& cached = b->attacks(true);
+  attack_info fresh;
+  b->update_attacks(fresh);
+  if (cached.checkers != fresh.checkers || cached.unsafe != fresh.unsafe) errors++;
+  for (int side = 0; side < 2; side++) {
+    if (cached.pinned[side] != fresh.pinned[side] || cached.pinners[side] != fresh.pinners[side]) errors++;
+  }
+
+  // the side to move's maps use the real occupancy, and the opponent's see
+  // through our king:
+  int us = b->turn;
+  int them = (us == WHITE) ? BLACK : WHITE;
+  U64 our_attacks = 0L, their_attacks = 0L;
+  for (int piece = PAWN; piece <= KING; piece++) {
+    our_attacks |= cached.attacks[us + piece];
+    their_attacks |= cached.attacks[them + piece];
+  }
+  U64 occupied = b->W | b->B;
+  U64 us_bb = (us == WHITE) ? b->W : b->B;
+  U64 them_bb = (us == WHITE) ? b->B : b->W;
+  for (int sq = 0; sq < 64; sq++) {
+    bool attacked = b->get_attackers(occupied, sq) & us_bb;
+    if (attacked != (bool) ((our_attacks >> sq) & 1)) errors++;
+    attacked = b->get_attackers(occupied ^ b->bitboard[KING + us], sq) & them_bb;
+    if (attacked != (bool) ((their_attacks >> sq) & 1)) errors++;
+  }
+
+  return errors;
 }
 
 // verify(): verifies the validity of the state of the board
@@ -160,15 +311,16 @@ bool verify(board* b) {
     }
   }
 
-  // make sure the board's base_score equals its actual base score:
-  int total = 0;
+  // make sure the board's base_score equals its actual base score (in both phases):
+  int opening = 0, endgame = 0;
   for (int i = 0; i < 64; i++) {
     if (b->piece_board[i] == NONE) continue;
-    total += PIECE_SQUARE_TABLE[OPENING_PHASE][b->piece_board[i]][i];
+    opening += PIECE_SQUARE_TABLE[OPENING_PHASE][b->piece_board[i]][i];
+    endgame += PIECE_SQUARE_TABLE[ENDGAME_PHASE][b->piece_board[i]][i];
   }
 
-  if (total != b->base_score_opening) {
-    printf("PST SCORES DIFFER\n", total, b->base_score_opening);
+  if (opening != OPENING_SCORE(b->base_score) || endgame != ENDGAME_SCORE(b->base_score)) {
+    printf("PST SCORES DIFFER\n");
     assert(false);
   }
 
@@ -185,6 +337,16 @@ bool verify(board* b) {
     assert(false);
   }
 
+  // make sure the material key counts the pieces on the board:
+  U64 material_key = 0L;
+  for (int piece = WP; piece < NONE; piece++) {
+    material_key += __builtin_popcountll(b->bitboard[piece]) * MATERIAL_KEY(piece);
+  }
+  if (b->material_key != material_key) {
+    printf("WRONG MATERIAL KEY\n");
+    assert(false);
+  }
+
   // make sure game phase score calculation is correct:
   int game_phase_score = 0;
   for (int piece = WN; piece < BK; piece++) {
@@ -194,6 +356,72 @@ bool verify(board* b) {
     printf("WRONG GAME PHASE SCORE\n");
     assert(false);
   }
+
+  return true;
+}
+
+// the contents of every entry written by tt_stress_test() are a function of its
+// hash, so any entry we read can be checked against the hash we probed with:
+static int stress_value(U64 hash) { return (int) ((hash >> 20) & 0x3FFF) - 0x2000; }
+static int stress_eval(U64 hash) { return (int) ((hash >> 34) & 0x3FFF) - 0x2000; }
+static int stress_move(U64 hash) { return (int) (((hash >> 8) & 0xFFF) << 20); }
+static int stress_depth(U64 hash) { return (int) (hash % 64); }
+static int stress_flag(U64 hash) { return (int) ((hash >> 8) % 3); }
+
+// tt_stress_test(): hammers a small transposition table from many threads at
+// once, with many different positions fighting over the same few buckets. a
+// probe may miss, but a hit must never return another position's data (or a
+// mix of two entries torn by concurrent writes). keys are 16 bits, so a torn
+// entry slips through the key check with the same 1/65536 odds as a genuine
+// key collision - we allow for that, but nothing more.
+bool tt_stress_test(int num_threads, int operations_per_thread) {
+  printf("starting test: tt stress test\n");
+
+  transposition_table table(1);
+  table.clear();
+
+  // every 16 positions share one bucket (with distinct 16-bit keys):
+  const int NUM_POSITIONS = 16 * 1024;
+  std::vector<U64> hashes(NUM_POSITIONS);
+  std::mt19937_64 rng(12345);
+  for (int i = 0; i < NUM_POSITIONS; i++) {
+    U64 low = (((U64) (i / 16) << 32) + table.num_buckets - 1) / table.num_buckets;
+    hashes[i] = ((U64) i << 48) | (rng() & 0xFFFF00000000L) | low;
+  }
+
+  std::atomic<long> hits(0);
+  std::atomic<long> errors(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.push_back(std::thread([&, t]() {
+      std::mt19937_64 thread_rng(t);
+      tt_data entry;
+      for (int i = 0; i < operations_per_thread; i++) {
+        U64 hash = hashes[thread_rng() % NUM_POSITIONS];
+        if (i & 1) {
+          table.put(hash, stress_depth(hash), stress_value(hash), stress_eval(hash),
+                    stress_move(hash), stress_flag(hash), true);
+        }
+        else if (table.read(hash, entry)) {
+          hits++;
+          if (entry.value != stress_value(hash) || entry.eval != stress_eval(hash) ||
+              entry.best_move != MOVE_SHORT(stress_move(hash)) ||
+              entry.depth != stress_depth(hash) || entry.flag != stress_flag(hash)) errors++;
+        }
+      }
+    }));
+  }
+  for (int t = 0; t < num_threads; t++) threads[t].join();
+
+  table.resize(0);
+
+  if (errors > hits / 65536 || !hits) {
+    printf("tt stress test %sFAILED%s: %ld bad entries in %ld hits\n", RED, RESET,
+           errors.load(), hits.load());
+    return false;
+  }
+  printf("tt stress test %sPASSED%s (%ld hits).\n", GREEN, RESET, hits.load());
+  return true;
 }
 
 // test_checks(): tests the gives_check() function in eval.cpp
@@ -221,4 +449,180 @@ bool verify(board* b) {
       b.print();
     }
   }
-} */
\ No newline at end of file
+} */
+// perft_nnue(): counts the positions (up to the given depth) in which the
+// incrementally updated NNUE accumulator differs from a refreshed one:
+long perft_nnue(board* b, int depth) {
+  nnue_accumulator incremental = b->accumulators[b->ply];
+  nnue_refresh(*b, 0);
+  nnue_refresh(*b, 1);
+  long errors = memcmp(incremental.values, b->accumulators[b->ply].values, sizeof(incremental.values)) != 0;
+  if (depth == 0) return errors;
+
+  int moves[MAX_POSITION_MOVES];
+  int num_moves = b->get_moves(moves);
+  for (int i = 0; i < num_moves; i++) {
+    b->make_move(moves[i]);
+    errors += perft_nnue(b, depth - 1);
+    b->undo_move();
+  }
+
+  // a null move doesn't change the accumulator:
+  b->make_nullmove();
+  errors += perft_nnue(b, 0);
+  b->undo_nullmove();
+
+  return errors;
+}
+
+// perft_packed(): pack every position and compare the unpacked board with the
+// original:
+long perft_packed(board* b, int depth) {
+  int moves[MAX_POSITION_MOVES];
+  int num_moves = b->get_moves(moves);
+  long errors = 0;
+
+  if (depth > 1) {
+    for (int i = 0; i < num_moves; i++) {
+      b->make_move(moves[i]);
+      errors += perft_packed(b, depth - 1);
+      b->undo_move();
+    }
+  }
+
+  static board unpacked(FEN_START);
+  packed_position p;
+  if (!pack_position(*b, PACKED_DRAW, p)) return errors + 1;
+  unpack_position(p, unpacked);
+  if (memcmp(unpacked.bitboard, b->bitboard, sizeof(b->bitboard)) ||
+      memcmp(unpacked.piece_board, b->piece_board, sizeof(b->piece_board)) ||
+      unpacked.turn != b->turn || unpacked.castle_rights != b->castle_rights ||
+      unpacked.fifty_move_counter != b->fifty_move_counter ||
+      unpacked.hash != b->hash || unpacked.pawn_hash != b->pawn_hash ||
+      unpacked.material_key != b->material_key || unpacked.base_score != b->base_score ||
+      unpacked.game_phase_score != b->game_phase_score ||
+      unpacked.W != b->W || unpacked.B != b->B) errors++;
+
+  return errors;
+}
+
+// packed_file_test(): convert a small EPD file, and read it back both memory
+// mapped and parsed:
+bool packed_file_test() {
+  const char* fens[3] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - c9 \"1-0\";",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 b - - c9 \"1/2-1/2\";",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - c9 \"0-1\";"
+  };
+  const double results[3] = {1.0, 0.5, 0.0};
+
+  std::ofstream epd("packed_test.epd");
+  for (int i = 0; i < 3; i++) epd << fens[i] << "\n";
+  epd << "a line without a result\n";
+  epd.close();
+
+  bool passed = pack_epd_file("packed_test.epd", "packed_test.bin") == 3;
+  packed_file mapped, parsed;
+  passed &= mapped.open("packed_test.bin") && mapped.size() == 3;
+  passed &= parsed.load_epd("packed_test.epd", 2) && parsed.size() == 2;
+  for (int i = 0; passed && i < 3; i++) {
+    packed_position expected;
+    parse_epd_line(fens[i], expected);
+    passed &= !memcmp(&mapped[i], &expected, sizeof(packed_position));
+    passed &= packed_result(mapped[i]) == results[i];
+    if (i < 2) passed &= !memcmp(&parsed[i], &expected, sizeof(packed_position));
+  }
+
+  mapped.close();
+  remove("packed_test.epd");
+  remove("packed_test.bin");
+
+  if (passed) printf("packed file test %sPASSED%s.\n", GREEN, RESET);
+  else printf("packed file test %sFAILED%s\n", RED, RESET);
+  return passed;
+}
+
+// nnue_test(): loads a network with random weights, and makes sure the
+// accumulator make_move() updates is always the one we'd compute from scratch,
+// and that the SIMD kernels evaluate exactly like the scalar ones:
+bool nnue_test() {
+  std::mt19937 rng(1);
+  std::string network;
+  auto put = [&](const void* data, int size) { network.append((const char*) data, size); };
+  auto put_u32 = [&](uint32_t value) { put(&value, 4); };
+  auto put_random = [&](int count, int size, int range) {
+    for (int i = 0; i < count; i++) {
+      int32_t value = (int32_t) (rng() % (2 * range + 1)) - range;
+      put(&value, size);
+    }
+  };
+
+  put_u32(NNUE_VERSION);
+  put_u32(0);
+  put_u32(0); // no description
+  put_u32(0);
+  put_random(NNUE_HALF_DIMENSIONS, 2, 64);
+  put_random(NNUE_INPUT_DIMENSIONS * NNUE_HALF_DIMENSIONS, 2, 32);
+  put_u32(0);
+  put_random(NNUE_HIDDEN_DIMENSIONS, 4, 4096);
+  put_random(NNUE_HIDDEN_DIMENSIONS * 2 * NNUE_HALF_DIMENSIONS, 1, 127);
+  put_random(NNUE_HIDDEN_DIMENSIONS, 4, 4096);
+  put_random(NNUE_HIDDEN_DIMENSIONS * NNUE_HIDDEN_DIMENSIONS, 1, 127);
+  put_random(1, 4, 4096);
+  put_random(NNUE_HIDDEN_DIMENSIONS, 1, 127);
+
+  // a truncated network must be rejected:
+  std::istringstream truncated(network.substr(0, network.size() - 1));
+  if (nnue_load(truncated) || nnue_network) {
+    printf("nnue test %sFAILED%s: loaded a truncated network\n", RED, RESET);
+    return false;
+  }
+
+  std::istringstream in(network);
+  if (!nnue_load(in)) {
+    printf("nnue test %sFAILED%s: could not load the network\n", RED, RESET);
+    return false;
+  }
+
+  const char* fens[] = {
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - ",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - "
+  };
+  long errors = 0;
+  for (int i = 0; i < 3; i++) {
+    board b((char*) fens[i]);
+    nnue_evaluate(b);
+    errors += perft_nnue(&b, 3);
+  }
+
+  // the scalar evaluation of the positions above must match the one computed
+  // when this test was written, and the SIMD kernels (in AVX2 and SSE4.1 builds)
+  // must give exactly the scalar evaluation, in those positions and in every
+  // position one move after them:
+  const int scores[] = {423, 1244, 902};
+  long wrong_scores = 0;
+  for (int i = 0; i < 3; i++) {
+    board b((char*) fens[i]);
+    if (nnue_evaluate_scalar(b) != scores[i]) wrong_scores++;
+    int moves[MAX_POSITION_MOVES];
+    int num_moves = b.get_moves(moves);
+    for (int j = -1; j < num_moves; j++) {
+      if (j >= 0) b.make_move(moves[j]);
+      if (nnue_evaluate(b) != nnue_evaluate_scalar(b)) wrong_scores++;
+      if (j >= 0) b.undo_move();
+    }
+  }
+  nnue_unload();
+
+  if (errors) {
+    printf("nnue test %sFAILED%s: %ld wrong accumulators\n", RED, RESET, errors);
+    return false;
+  }
+  if (wrong_scores) {
+    printf("nnue test %sFAILED%s: %ld wrong evaluations\n", RED, RESET, wrong_scores);
+    return false;
+  }
+  printf("nnue test %sPASSED%s.\n", GREEN, RESET);
+  return true;
+}
@@ -1,65 +1,223 @@
 #include "tt.h"
 
+// scores within this distance of INF are mate (or tablebase) scores. they are
+// squeezed into the top of the 16-bit range, everything else is clamped below:
+#define TT_MATE_BOUND (INF - 1000)
+#define TT_MATE_VALUE 32000
+#define TT_NO_EVAL (-32768)
+
+// value_to_tt() / value_from_tt(): convert scores to and from 16 bits:
+static inline U64 value_to_tt(int value) {
+  if (value >= TT_MATE_BOUND) value = value - INF + TT_MATE_VALUE;
+  else if (value <= -TT_MATE_BOUND) value = value + INF - TT_MATE_VALUE;
+  else value = std::min(std::max(value, -TT_MATE_VALUE + 1001), TT_MATE_VALUE - 1001);
+  return (uint16_t) value;
+}
+
+static inline int value_from_tt(U64 value) {
+  int v = (int16_t) value;
+  if (v >= TT_MATE_VALUE - 1000) return v - TT_MATE_VALUE + INF;
+  if (v <= -TT_MATE_VALUE + 1000) return v + TT_MATE_VALUE - INF;
+  return v;
+}
+
+// fold_key(): hash a data word down to 16 bits (XORed into the stored key):
+static inline uint16_t fold_key(U64 data) {
+  return (data * 0x9E3779B97F4A7C15ULL) >> 48;
+}
+
+// macros for getting information out of a data word:
+#define TT_DATA_MOVE(data) ((data) & 0xFFFF)
+#define TT_DATA_VALUE(data) (((data) >> 16) & 0xFFFF)
+#define TT_DATA_EVAL(data) (((data) >> 32) & 0xFFFF)
+#define TT_DATA_DEPTH(data) (((data) >> 48) & 0xFF)
+#define TT_DATA_BOUND(data) (((data) >> 56) & 0x3) // flag + 1 (0 = empty)
+#define TT_DATA_PV(data) (((data) >> 58) & 0x1)
+#define TT_DATA_AGE(data) (((data) >> 59) & 0x1F)
+
 // the transposition table constructor:
-transposition_table::transposition_table(U64 MB) {
-  // make sure num_entries is a power of 2:
-  U64 bytes = MB << 20;
-  U64 max_entries = bytes / sizeof(tt_entry);
-
-  // make sure max_entries is a power of 2:
-  U64 num_entries = max_entries;
-  while (num_entries & (num_entries - 1)) {
-    POP_LSB(num_entries);
+transposition_table::transposition_table(U64 MB) :
+  TT(NULL), memory(NULL), memory_size(0), mmapped(false), age(0) {
+  resize(MB);
+}
+
+// resize(): reallocate the table with the given size (in MB). the new table
+// is empty. resize(0) frees the table:
+void transposition_table::resize(U64 MB) {
+  // free the old table:
+  if (memory) {
+    #if defined(__linux__)
+      if (mmapped) munmap(memory, memory_size);
+      else delete[] memory;
+    #else
+      delete[] memory;
+    #endif
   }
 
-  this->num_entries = num_entries;
-  this->size = num_entries * sizeof(tt_entry);
-  this->mask = num_entries - 1;
-  this->age = 0;
+  TT = NULL;
+  memory = NULL;
+  memory_size = 0;
+  mmapped = false;
+
+  num_buckets = (MB << 20) / sizeof(tt_bucket);
+  num_entries = num_buckets * TT_BUCKET_ENTRIES;
+  size = num_buckets * sizeof(tt_bucket);
+  if (!size) return;
+
+  #if defined(__linux__)
+    // on linux, we ask for huge pages: they cut the TLB misses of random
+    // probes into a big table. first we try explicit huge pages (MAP_HUGETLB,
+    // which only works if the admin reserved some), then we fall back to a
+    // regular mapping aligned to 2 MB and advise the kernel to back it with
+    // transparent huge pages. either way, fresh mappings are already zeroed,
+    // so there is no need to clear() them:
+    const U64 HUGE_PAGE_SIZE = 2 << 20;
+    U64 rounded_size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
 
-  TT = new tt_entry[num_entries];
+    #if defined(MAP_HUGETLB)
+      void* p = mmap(NULL, rounded_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p != MAP_FAILED) {
+        memory = (char*) p;
+        memory_size = rounded_size;
+        mmapped = true;
+        TT = (tt_bucket*) memory;
+        return;
+      }
+    #endif
+
+    void* q = mmap(NULL, rounded_size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (q != MAP_FAILED) {
+      memory = (char*) q;
+      memory_size = rounded_size + HUGE_PAGE_SIZE;
+      mmapped = true;
+      TT = (tt_bucket*) (((uintptr_t) memory + HUGE_PAGE_SIZE - 1) & ~((uintptr_t) HUGE_PAGE_SIZE - 1));
+      #if defined(MADV_HUGEPAGE)
+        madvise(TT, rounded_size, MADV_HUGEPAGE);
+      #endif
+      return;
+    }
+  #endif
+
+  // otherwise, allocate the table on the heap, aligned to the start of a cache line:
+  memory = new char[size + 64];
+  memory_size = size + 64;
+  TT = (tt_bucket*) (((uintptr_t) memory + 63) & ~((uintptr_t) 63));
+  clear();
+}
+
+// read(): read the entry for the given position. returns false if there is
+// no (valid) entry for this position:
+bool transposition_table::read(U64 hash, tt_data& data) {
+  tt_bucket* bucket = &TT[index(hash)];
+  uint16_t key = hash >> 48;
+
+  for (int i = 0; i < TT_BUCKET_ENTRIES; i++) {
+    // relaxed loads are enough here, since the key check catches torn entries:
+    U64 d = bucket->data[i].load(std::memory_order_relaxed);
+    uint16_t k = bucket->keys[i].load(std::memory_order_relaxed);
+
+    // make sure the entry belongs to this position (and isn't torn or empty):
+    if ((k ^ fold_key(d)) != key || !TT_DATA_BOUND(d)) continue;
+
+    data.best_move = TT_DATA_MOVE(d);
+    data.value = value_from_tt(TT_DATA_VALUE(d));
+    data.eval = (int16_t) TT_DATA_EVAL(d) == TT_NO_EVAL ? NO_SCORE : (int16_t) TT_DATA_EVAL(d);
+    data.depth = TT_DATA_DEPTH(d);
+    data.flag = TT_DATA_BOUND(d) - 1;
+    data.tt_age = TT_DATA_AGE(d);
+    data.is_pv = TT_DATA_PV(d);
+    return true;
+  }
+
+  return false;
 }
 
 // probe(): probe the transposition table for the given position:
-int transposition_table::probe(int depth, int alpha, int beta) {
-  tt_entry* entry = &TT[b.hash & mask];
+int transposition_table::probe(U64 hash, int depth, int alpha, int beta, int* eval) {
+  PROFILE(PROFILE_TT_PROBE);
 
-  // verify that the entry is not a collision:
-  if (entry->hash != b.hash) return TT_NO_MATCH;
+  tt_data entry;
+  if (eval) *eval = NO_SCORE;
+  if (!read(hash, entry)) return TT_NO_MATCH;
+  if (eval) *eval = entry.eval;
 
   // make sure we're at a good enough depth to use the data in this entry:
-  if (entry->depth >= depth) {
-    if (entry->flag == TT_EXACT) return entry->value;
-    if (entry->flag == TT_ALPHA && entry->value <= alpha) return alpha;
-    if (entry->flag == TT_BETA && entry->value >= beta) return beta;
+  if (entry.depth >= depth) {
+    if (entry.flag == TT_EXACT) return entry.value;
+    if (entry.flag == TT_ALPHA && entry.value <= alpha) return alpha;
+    if (entry.flag == TT_BETA && entry.value >= beta) return beta;
   }
 
   // should never be called, but here just in case:
   return TT_NO_MATCH;
 }
 
+// best_move(): the best move stored for this position as a short move
+// (see MOVE_SHORT), or NULL if none:
+int transposition_table::best_move(U64 hash) {
+  tt_data entry;
+  return read(hash, entry) ? entry.best_move : NULL;
+}
+
 // put(): write a new entry to the transposition table:
-void transposition_table::put(int depth, int value, int best_move, char flag, bool is_pv) {
-  tt_entry* entry = &TT[b.hash & mask];
-
-  // write the data:
-  if (entry->hash == 0L ||
-      entry->tt_age != age ||
-      is_pv ||
-      (!entry->is_pv && depth >= entry->depth) ||
-      (entry->hash == b.hash && depth >= entry->depth))
-  {
-    entry->hash = b.hash;
-    entry->depth = depth;
-    entry->flag = flag;
-    entry->tt_age = age;
-    entry->value = value;
-    entry->best_move = best_move;
-    entry->is_pv = is_pv;
+void transposition_table::put(U64 hash, int depth, int value, int eval, int best_move, char flag, bool is_pv) {
+  tt_bucket* bucket = &TT[index(hash)];
+  uint16_t key = hash >> 48;
+  int short_move = MOVE_SHORT(best_move);
+
+  // find the entry to replace: this position's own entry if it has one, and
+  // otherwise the shallowest entry, where older entries count as shallower:
+  int replace = 0;
+  int worst = INF;
+  for (int i = 0; i < TT_BUCKET_ENTRIES; i++) {
+    U64 d = bucket->data[i].load(std::memory_order_relaxed);
+    uint16_t k = bucket->keys[i].load(std::memory_order_relaxed);
+
+    if ((k ^ fold_key(d)) == key && TT_DATA_BOUND(d)) {
+      // only overwrite our own entry with data that is at least as good:
+      if (!is_pv && flag != TT_EXACT && TT_DATA_AGE(d) == (age & 0x1F) &&
+          depth < (int) TT_DATA_DEPTH(d)) return;
+
+      // don't lose the best move we already know about:
+      if (!short_move) short_move = TT_DATA_MOVE(d);
+      replace = i;
+      break;
+    }
+
+    // empty entries are always replaced first:
+    int relative_age = (age - TT_DATA_AGE(d)) & 0x1F;
+    int score = TT_DATA_BOUND(d) ? (int) TT_DATA_DEPTH(d) - 8 * relative_age : -INF;
+    if (score < worst) {
+      worst = score;
+      replace = i;
+    }
   }
+
+  // write the data word first, then the key that validates it:
+  U64 d = ((U64) short_move) |
+          (value_to_tt(value) << 16) |
+          ((U64) (uint16_t) (eval == NO_SCORE ? TT_NO_EVAL : std::min(std::max(eval, -TT_MATE_VALUE), TT_MATE_VALUE)) << 32) |
+          ((U64) std::min(std::max(depth, 0), 255) << 48) |
+          ((U64) (flag + 1) << 56) |
+          ((U64) is_pv << 58) |
+          ((U64) (age & 0x1F) << 59);
+
+  bucket->data[replace].store(d, std::memory_order_relaxed);
+  bucket->keys[replace].store(key ^ fold_key(d), std::memory_order_relaxed);
 }
 
-// clear(): clears the table:
+// clear(): clears the table (splitting the work over num_threads threads):
 void transposition_table::clear() {
-  memset(TT, 0, size);
+  int n = std::max(num_threads, 1);
+  U64 chunk = (num_buckets + n - 1) / n;
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < n; i++) {
+    U64 start = std::min(i * chunk, num_buckets);
+    U64 end = std::min(start + chunk, num_buckets);
+    threads.push_back(std::thread(memset, TT + start, 0, (end - start) * sizeof(tt_bucket)));
+  }
+  for (int i = 0; i < n; i++) threads[i].join();
 }
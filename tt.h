@@ -2,21 +2,35 @@
 #ifndef TT_H
 #define TT_H
 
+#include <atomic>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+  #include <sys/mman.h>
+#endif
+
 #include "consts.h"
 #include "globals.h"
+#include "profile.h"
 
-struct tt_entry {
-  // the hash of the position:
-  U64 hash;
+// number of entries in a single (cache line sized) bucket:
+#define TT_BUCKET_ENTRIES 6
 
+// tt_data: the contents of a transposition table entry, unpacked:
+struct tt_data {
   // the move value:
   int value;
 
-  // the best move found in this position:
+  // the static evaluation of this position (NO_SCORE if unknown):
+  int eval;
+
+  // the best move found in this position, as a short (16-bit) move:
   int best_move;
 
   // the depth to which the engine analyzed this position:
-  char depth;
+  int depth;
 
   // the transposition table flag (either TT_EXACT, TT_ALPHA, or TT_BETA):
   char flag;
@@ -28,30 +42,81 @@ struct tt_entry {
   bool is_pv;
 };
 
+/* tt_bucket: one 64-byte cache line holding TT_BUCKET_ENTRIES entries of 10
+ * bytes each - a 16-bit key and a 64-bit data word with the following layout:
+ * 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 1111 1111 1111 1111 -> best move (16 bits)
+ * 0000 0000 0000 0000 0000 0000 0000 0000 1111 1111 1111 1111 0000 0000 0000 0000 -> value (16 bits)
+ * 0000 0000 0000 0000 1111 1111 1111 1111 0000 0000 0000 0000 0000 0000 0000 0000 -> static eval (16 bits)
+ * 0000 0000 1111 1111 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 -> depth (8 bits)
+ * 1111 1111 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 -> age (5 bits), PV (1 bit), flag + 1 (2 bits)
+ *
+ * the keys and data words are stored apart so every data word is 8-byte aligned
+ * and can be read and written atomically. search threads use the table without
+ * locks, so the key is the top 16 bits of the hash XORed with a fold of the data
+ * word: an entry torn by two racing writes fails the key check just like an
+ * entry belonging to another position does.
+*/
+struct tt_bucket {
+  std::atomic<U64> data[TT_BUCKET_ENTRIES];
+  std::atomic<uint16_t> keys[TT_BUCKET_ENTRIES];
+  char padding[64 - TT_BUCKET_ENTRIES * (sizeof(U64) + sizeof(uint16_t))];
+};
+
 struct transposition_table {
-  // the transposition table entries:
-  tt_entry* TT;
+  // the transposition table buckets (aligned to 64 bytes):
+  tt_bucket* TT;
+
+  // the memory block the buckets live in, its size in bytes, and whether it
+  // was allocated with mmap() (so we know how to free it):
+  char* memory;
+  U64 memory_size;
+  bool mmapped;
 
   // the age of the transposition table:
   char age;
 
-  // number of entries & size in bytes:
+  // number of buckets, number of entries & size in bytes:
+  U64 num_buckets;
   U64 num_entries;
   U64 size;
 
-  // the mask we use for TT indexing:
-  U64 mask;
-
   // the constructor:
   transposition_table(U64 MB);
 
-  // probe(): probe the transposition table for the given position:
-  int probe(int depth, int alpha, int beta);
+  // resize(): reallocate the table with the given size (in MB). the new table
+  // is empty. resize(0) frees the table:
+  void resize(U64 MB);
+
+  // index(): the bucket a position maps to. the table size doesn't have to be
+  // a power of 2, so we map the low 32 bits of the hash onto [0, num_buckets)
+  // with a multiply instead of a mask (the key uses the top 16 bits). this
+  // reaches at most 2^32 buckets, which is why MAX_TT_SIZE is 256 GB:
+  inline U64 index(U64 hash) {
+    return ((hash & 0xFFFFFFFF) * num_buckets) >> 32;
+  }
+
+  // prefetch(): start pulling the bucket of the given position into the cache,
+  // so it's already there when we probe it:
+  inline void prefetch(U64 hash) {
+    __builtin_prefetch(&TT[index(hash)]);
+  }
+
+  // read(): read the entry for the given position. returns false if there is
+  // no (valid) entry for this position:
+  bool read(U64 hash, tt_data& data);
+
+  // probe(): probe the transposition table for the given position. if eval
+  // is given, it's set to the stored static evaluation (or NO_SCORE):
+  int probe(U64 hash, int depth, int alpha, int beta, int* eval = NULL);
+
+  // best_move(): the best move stored for this position as a short move
+  // (see MOVE_SHORT), or NULL if none:
+  int best_move(U64 hash);
 
   // put(): write a new entry to the transposition table:
-  void put(int depth, int value, int best_move, char flag, bool is_pv);
+  void put(U64 hash, int depth, int value, int eval, int best_move, char flag, bool is_pv);
 
-  // clear(): clears the table:
+  // clear(): clears the table (splitting the work over num_threads threads):
   void clear();
 };
 
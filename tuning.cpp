@@ -3,54 +3,70 @@
 int main(int argc, char** argv) {
   // tuner settings:
   char* POSITIONS_FILE = "tuning/quiet-labeled.epd";
-  int NUM_POSITIONS_TO_EXTRACT = 700000;
+  int NUM_POSITIONS_TO_EXTRACT = 700000; // (only for EPD files)
 
   // initialize consts and globals:
   init_consts();
   init_globals();
 
+  // 'tuner.out pack <EPD file> <packed file>' converts a positions file:
+  if (argc == 4 && !strcmp(argv[1], "pack")) {
+    long count = pack_epd_file(argv[2], argv[3]);
+    if (count < 0) printf("error: can't convert %s to %s.\n", argv[2], argv[3]);
+    else printf("packed %ld positions\n", count);
+    return count < 0;
+  }
+
+  // usage: tuner.out [threads] [gradient|local] [positions file] (defaults to
+  // one thread per core, the gradient tuner and POSITIONS_FILE):
+  num_threads = (argc > 1) ? atoi(argv[1]) : std::thread::hardware_concurrency();
+  if (num_threads < 1) num_threads = 1;
+  bool gradient = (argc <= 2) || strcmp(argv[2], "local");
+  if (argc > 3) POSITIONS_FILE = argv[3];
+
   // initialize the dependency list and the rest of the parameter list:
   initialize_params_and_dependencies();
 
+  // set up the MSE() threads:
+  for (int i = 0; i < num_threads; i++) tuning_threads.push_back(new tuning_thread());
+
   // start the tuner!
-  printf("starting luna tuner...\n");
-  tune(POSITIONS_FILE, NUM_POSITIONS_TO_EXTRACT);
+  printf("starting luna %s tuner (%d threads)...\n", gradient ? "gradient" : "local", num_threads);
+  tune(POSITIONS_FILE, NUM_POSITIONS_TO_EXTRACT, gradient);
 
   return 0;
 }
 
-void tune(char* POSITIONS_FILE, int NUM_POSITIONS_TO_EXTRACT) {
-  // load the positions file:
-  std::ifstream ifs(POSITIONS_FILE);
+void tune(char* POSITIONS_FILE, int NUM_POSITIONS_TO_EXTRACT, bool gradient) {
+  // load the positions file. EPD files are parsed (once) into memory, packed
+  // files (see packed.h) are memory mapped as they are:
+  packed_file positions;
+  int length = strlen(POSITIONS_FILE);
+  bool is_epd = length >= 4 && !strcmp(POSITIONS_FILE + length - 4, ".epd");
+  bool loaded = is_epd ? positions.load_epd(POSITIONS_FILE, NUM_POSITIONS_TO_EXTRACT)
+                       : positions.open(POSITIONS_FILE);
 
   // ensure the file is valid:
-  if (ifs.fail()) {
+  if (!loaded) {
     printf("error: file %s not found.\n", POSITIONS_FILE);
     return;
   }
 
-  // parse the file for positions and their respective final result:
-  std::vector<position_data*> positions;
-  std::string result;
-  for (int i = 0; i < NUM_POSITIONS_TO_EXTRACT; i++) {
-    position_data* p = new position_data();
-    ifs.getline(p->fen, 128, '"');
-    std::getline(ifs, result);
-
-    // parse game result:
-    if (result.find("1-0") != std::string::npos) p->result = 1.0;
-    else if (result.find("1/2") != std::string::npos) p->result = 0.5;
-    else if (result.find("0-1") != std::string::npos) p->result = 0.0;
-    else {
-      i--;
-      continue;
-    }
+  printf("successfully loaded %d positions\n", (int) positions.size());
 
-    positions.push_back(p);
-  }
-
-  printf("successfully loaded %d positions\n", positions.size());
+  if (gradient) tune_gradient(positions);
+  else tune_local(positions);
+}
 
+/* tune_local(): texel's local search, which tries changing every parameter by
+ * +/-1 and keeps the changes that lower the MSE. most parameters only take part
+ * in the evaluation of a few positions (a knight PST entry only matters with a
+ * knight on that square), so the squared error of every position is cached,
+ * and a tweak only re-evaluates the positions in the parameter's support (from
+ * the eval trace). parameters evaluate() doesn't trace are assumed to affect
+ * every position.
+*/
+void tune_local(packed_file& positions) {
   // temporarily store the current param values in order to calculate the initial MSE:
   std::vector<int> best_param_values;
   copy_params(best_param_values);
@@ -64,9 +80,32 @@ void tune(char* POSITIONS_FILE, int NUM_POSITIONS_TO_EXTRACT) {
   ofs.close();
   return; */
 
-  // tune the parameters!
-  double best_MSE = MSE(best_param_values, positions);
+  // build the inverted index (the positions in each parameter's support):
+  std::vector<traced_position> traced;
+  std::vector<trace_coefficient> coefficients;
+  std::vector<bool> is_traced;
+  trace_positions(positions, traced, coefficients, &is_traced);
+
   int num_params = params.size();
+  std::vector<std::vector<int>> supports(num_params);
+  for (int p = 0; p < traced.size(); p++) {
+    for (int c = traced[p].begin; c < traced[p].end; c++) supports[coefficients[c].param].push_back(p);
+  }
+  std::vector<int> all_positions(positions.size());
+  for (int p = 0; p < positions.size(); p++) all_positions[p] = p;
+  std::vector<trace_coefficient>().swap(coefficients);
+  std::vector<traced_position>().swap(traced);
+
+  // cache the squared error of every position:
+  std::vector<double> errors(positions.size());
+  std::vector<double> new_errors(positions.size());
+  // (starting from errors of 0, the delta is the total squared error):
+  load_params(best_param_values);
+  double total_error = support_error_delta(positions, all_positions, errors, new_errors);
+  errors.swap(new_errors);
+
+  // tune the parameters!
+  double best_MSE = total_error / positions.size();
   int num_epochs = 1;
   bool improved = true;
   while (improved) {
@@ -74,30 +113,34 @@ void tune(char* POSITIONS_FILE, int NUM_POSITIONS_TO_EXTRACT) {
 
     improved = false;
     for (int param = 0; param < num_params; param++) {
-      // make a deep copy of the current best parameters:
-      std::vector<int> new_params;
-      copy_params(new_params);
+      std::vector<int>& support = is_traced[param] ? supports[param] : all_positions;
+      if (support.empty()) continue;
 
       // guess the direction that further minimizes the MSE:
-      new_params[param]++;
-      double new_MSE = MSE(new_params, positions);
-      if (new_MSE < best_MSE) {
-        best_MSE = new_MSE;
+      std::vector<int> new_params(best_param_values);
+      bool accepted = false;
+      for (int step = 1; step >= -1 && !accepted; step -= 2) {
+        new_params[param] = best_param_values[param] + step;
         load_params(new_params);
-        improved = true;
-      }
-      else {
-        new_params[param] -= 2;
-        new_MSE = MSE(new_params, positions);
-        if (new_MSE < best_MSE) {
-          best_MSE = new_MSE;
-          load_params(new_params);
-          improved = true;
+        double delta = support_error_delta(positions, support, errors, new_errors);
+        if (delta < 0) {
+          for (int i = 0; i < support.size(); i++) errors[support[i]] = new_errors[support[i]];
+          total_error += delta;
+          best_param_values = new_params;
+          improved = accepted = true;
         }
       }
+
+      // the params have to be the best ones again for the next parameter:
+      load_params(best_param_values);
     }
 
-    // epoch over, output MSE info and save snapshot of weights to file:
+    // epoch over, recompute the MSE from scratch (so that rounding errors in the
+    // cached errors can't add up), output MSE info and save snapshot of weights to file:
+    std::fill(errors.begin(), errors.end(), 0.0);
+    total_error = support_error_delta(positions, all_positions, errors, new_errors);
+    errors.swap(new_errors);
+    best_MSE = total_error / positions.size();
     std::string output_filename = "tuning_" + std::to_string(num_epochs) + ".txt";
     save_params(output_filename.c_str());
     printf("finished epoch %d. current best MSE: %.4f\n", num_epochs, best_MSE);
@@ -105,36 +148,356 @@ void tune(char* POSITIONS_FILE, int NUM_POSITIONS_TO_EXTRACT) {
   }
 }
 
-// calculate the MSE of the sigmoid of the current engine's evaluation and the game's final result:
-double MSE(std::vector<int>& params, std::vector<position_data*>& positions) {
+/* tune_gradient(): traces the evaluation of every position once (see
+ * eval_trace), fits K, and then runs adam over all parameters at once. the
+ * evaluation is linear in the traced terms, so every iteration is a single pass
+ * over the coefficients that computes the MSE and its exact gradient. terms
+ * evaluate() doesn't trace (such as the game phase material scores) keep their
+ * values.
+*/
+void tune_gradient(packed_file& positions) {
+  std::vector<traced_position> traced;
+  std::vector<trace_coefficient> coefficients;
+  trace_positions(positions, traced, coefficients);
+  printf("traced %d positions (%d coefficients)\n", (int) traced.size(), (int) coefficients.size());
+
+  // the parameters are tuned as real numbers, starting from the current values:
+  std::vector<int> initial_values;
+  copy_params(initial_values);
+  std::vector<double> values(initial_values.begin(), initial_values.end());
+
+  // fit K to the current evaluation:
+  K = find_K(traced, coefficients, values);
+  printf("optimal K: %.4f\n", K);
+
+  int num_params = values.size();
+  std::vector<double> gradient(num_params);
+  std::vector<double> m(num_params, 0); // adam's moment estimates
+  std::vector<double> v(num_params, 0);
+  double previous_MSE = traced_MSE(traced, coefficients, values, NULL);
+  printf("initial MSE: %.6f\n", previous_MSE);
+  for (int epoch = 1; epoch <= GRADIENT_MAX_EPOCHS; epoch++) {
+    double current_MSE;
+    for (int i = 1; i <= GRADIENT_EPOCH_ITERATIONS; i++) {
+      current_MSE = traced_MSE(traced, coefficients, values, &gradient);
+
+      // adam update (with bias correction):
+      int t = (epoch - 1) * GRADIENT_EPOCH_ITERATIONS + i;
+      double m_correction = 1 - pow(ADAM_BETA1, t);
+      double v_correction = 1 - pow(ADAM_BETA2, t);
+      for (int p = 0; p < num_params; p++) {
+        m[p] = ADAM_BETA1 * m[p] + (1 - ADAM_BETA1) * gradient[p];
+        v[p] = ADAM_BETA2 * v[p] + (1 - ADAM_BETA2) * gradient[p] * gradient[p];
+        values[p] -= ADAM_LEARNING_RATE * (m[p] / m_correction) / (sqrt(v[p] / v_correction) + 1e-8);
+      }
+    }
+
+    // epoch over: round the params, check the actual MSE with them, and save a
+    // snapshot of them to file:
+    std::vector<int> rounded(num_params);
+    for (int p = 0; p < num_params; p++) rounded[p] = (int) round(values[p]);
+    double rounded_MSE = MSE(rounded, positions);
+    std::string output_filename = "tuning_" + std::to_string(epoch) + ".txt";
+    save_params(output_filename.c_str());
+    printf("finished epoch %d. traced MSE: %.6f, MSE with rounded params: %.6f\n", epoch, current_MSE, rounded_MSE);
+
+    if (previous_MSE - current_MSE < GRADIENT_MIN_IMPROVEMENT) break;
+    previous_MSE = current_MSE;
+  }
+}
+
+// trace_positions(): trace the evaluation of every position, and store the
+// coefficient of every parameter that takes part in it:
+void trace_positions(packed_file& positions, std::vector<traced_position>& traced,
+                     std::vector<trace_coefficient>& coefficients, std::vector<bool>* is_traced) {
+  // the parameter indices of the traced terms:
+  int bishop_pair = param_index(&BISHOP_PAIR_BONUS);
+  int doubled_pawns = param_index(&DOUBLED_PAWN_PENALTY);
+  int fully_open_files = param_index(&FULLY_OPEN_FILE_BONUS);
+  int semi_open_files = param_index(&SEMI_OPEN_FILE_BONUS);
+  int piece_square[2][6][64];
+  for (int phase = 0; phase < 2; phase++) {
+    for (int piece = WP; piece <= WK; piece++) {
+      for (int square = 0; square < 64; square++) {
+        piece_square[phase][piece][square] = param_index(&PIECE_SQUARE_TABLE[phase][piece][square]);
+      }
+    }
+  }
+
+  if (is_traced) {
+    is_traced->assign(params.size(), false);
+    (*is_traced)[bishop_pair] = (*is_traced)[doubled_pawns] = true;
+    (*is_traced)[fully_open_files] = (*is_traced)[semi_open_files] = true;
+    for (int phase = 0; phase < 2; phase++) {
+      for (int piece = WP; piece <= WK; piece++) {
+        for (int square = 0; square < 64; square++) (*is_traced)[piece_square[phase][piece][square]] = true;
+      }
+    }
+  }
+
+  std::vector<int> values;
+  copy_params(values);
+
+  board& b = tuning_threads[0]->b;
+  eval_trace trace;
+  eval_trace_target = &trace;
+  traced.reserve(positions.size());
+  for (int p = 0; p < positions.size(); p++) {
+    unpack_position(positions[p], b);
+    memset(&trace, 0, sizeof(eval_trace));
+    int eval = evaluate(b) * (b.turn == WHITE ? 1 : -1);
+
+    traced_position t;
+    t.result = packed_result(positions[p]);
+    t.begin = coefficients.size();
+
+    // the PSTs are tapered, so their coefficients are weighted by the phase.
+    // (the coefficients of terms that are present but weighted 0 are kept, so
+    // that they are part of the parameter's support for tune_local(): the
+    // endgame scale factor can change with the sign of the endgame score.)
+    double opening_weight = (double) trace.phase / OPENING_PHASE_SCORE;
+    double endgame_weight = (double) (OPENING_PHASE_SCORE - trace.phase) / OPENING_PHASE_SCORE *
+                            trace.scale / SCALE_NORMAL;
+    auto add = [&coefficients](int param, int count, double weight) {
+      if (!count) return;
+      trace_coefficient c = {param, (float) (count * weight)};
+      coefficients.push_back(c);
+    };
+    add(bishop_pair, trace.bishop_pair, 1);
+    add(doubled_pawns, trace.doubled_pawns, 1);
+    add(fully_open_files, trace.fully_open_files, 1);
+    add(semi_open_files, trace.semi_open_files, 1);
+    for (int piece = WP; piece <= WK; piece++) {
+      for (int square = 0; square < 64; square++) {
+        add(piece_square[OPENING_PHASE][piece][square], trace.piece_square[piece][square], opening_weight);
+        add(piece_square[ENDGAME_PHASE][piece][square], trace.piece_square[piece][square], endgame_weight);
+      }
+    }
+    t.end = coefficients.size();
+
+    // whatever the traced terms don't cover (the tempo bonus, untuned terms,
+    // rounding) stays fixed:
+    t.fixed_eval = eval;
+    for (int c = t.begin; c < t.end; c++) {
+      t.fixed_eval -= coefficients[c].coefficient * values[coefficients[c].param];
+    }
+
+    traced.push_back(t);
+  }
+  eval_trace_target = NULL;
+}
+
+// find_K(): the K that minimizes the MSE of the current evaluation (found by
+// ternary search, since the MSE has a single minimum in K):
+double find_K(std::vector<traced_position>& traced, std::vector<trace_coefficient>& coefficients,
+              std::vector<double>& values) {
+  double low = 0.0, high = 10.0;
+  while (high - low > 0.0001) {
+    double k1 = low + (high - low) / 3;
+    double k2 = high - (high - low) / 3;
+    K = k1;
+    double error1 = traced_MSE(traced, coefficients, values, NULL);
+    K = k2;
+    double error2 = traced_MSE(traced, coefficients, values, NULL);
+    if (error1 < error2) high = k2;
+    else low = k1;
+  }
+
+  return (low + high) / 2;
+}
+
+// traced_MSE(): the MSE of the traced evaluation with the given parameter
+// values, and (if gradient isn't NULL) its gradient with respect to them. like
+// MSE(), every thread works on one chunk and the chunks are added up in order:
+double traced_MSE(std::vector<traced_position>& traced, std::vector<trace_coefficient>& coefficients,
+                  std::vector<double>& values, std::vector<double>* gradient) {
+  std::vector<double> chunk_errors(num_threads);
+  std::vector<std::thread> helpers;
+  int chunk_size = (traced.size() + num_threads - 1) / num_threads;
+  for (int i = 0; i < num_threads; i++) {
+    int begin = std::min((int) traced.size(), i * chunk_size);
+    int end = std::min((int) traced.size(), begin + chunk_size);
+    tuning_thread* t = tuning_threads[i];
+    double* error = &chunk_errors[i];
+    bool with_gradient = gradient;
+    auto work = [t, error, &traced, &coefficients, &values, begin, end, with_gradient]() {
+      *error = t->traced_squared_error(traced, coefficients, values, begin, end, with_gradient);
+    };
+
+    if (i < num_threads - 1) helpers.push_back(std::thread(work));
+    else work();
+  }
+  for (int i = 0; i < helpers.size(); i++) helpers[i].join();
+
   double total_squared_error = 0;
+  for (int i = 0; i < num_threads; i++) total_squared_error += chunk_errors[i];
+
+  if (gradient) {
+    for (int p = 0; p < values.size(); p++) {
+      double sum = 0;
+      for (int i = 0; i < num_threads; i++) sum += tuning_threads[i]->gradient[p];
+      (*gradient)[p] = sum / traced.size();
+    }
+  }
+
+  return total_squared_error / traced.size();
+}
+
+double tuning_thread::traced_squared_error(std::vector<traced_position>& traced,
+                                           std::vector<trace_coefficient>& coefficients,
+                                           std::vector<double>& values, int begin, int end,
+                                           bool with_gradient) {
+  if (with_gradient) gradient.assign(values.size(), 0);
+
+  // d(sigmoid)/d(eval) = sigmoid * (1 - sigmoid) * K * ln(10) / 400:
+  double slope = K * log(10.0) / 400.0;
+
+  double sum = 0;
+  double compensation = 0;
+  for (int p = begin; p < end; p++) {
+    traced_position& t = traced[p];
+    double eval = t.fixed_eval;
+    for (int c = t.begin; c < t.end; c++) eval += coefficients[c].coefficient * values[coefficients[c].param];
+
+    double sigmoid = 1.0 / (1.0 + pow(10, -K * eval / 400.0));
+    double error = t.result - sigmoid;
+    double y = error * error - compensation;
+    double s = sum + y;
+    compensation = (s - sum) - y;
+    sum = s;
+
+    // d(error^2)/d(param) = -2 * error * d(sigmoid)/d(eval) * coefficient:
+    if (with_gradient) {
+      double factor = -2 * error * sigmoid * (1 - sigmoid) * slope;
+      for (int c = t.begin; c < t.end; c++) gradient[coefficients[c].param] += factor * coefficients[c].coefficient;
+    }
+  }
+
+  return sum;
+}
+
+// support_error_delta(): re-evaluate the given positions with the current
+// params, store their squared errors in new_errors, and return how much these
+// changed the total squared error (relative to the cached errors):
+double support_error_delta(packed_file& positions, std::vector<int>& support,
+                           std::vector<double>& errors, std::vector<double>& new_errors) {
+  // small supports aren't worth starting threads for:
+  int threads = std::min(num_threads, (int) support.size() / 4096 + 1);
+  std::vector<double> chunk_deltas(threads);
+  std::vector<std::thread> helpers;
+  int chunk_size = (support.size() + threads - 1) / threads;
+  for (int i = 0; i < threads; i++) {
+    int begin = std::min((int) support.size(), i * chunk_size);
+    int end = std::min((int) support.size(), begin + chunk_size);
+    tuning_thread* t = tuning_threads[i];
+    double* delta = &chunk_deltas[i];
+    auto work = [t, delta, &positions, &support, &errors, &new_errors, begin, end]() {
+      *delta = t->error_delta(positions, support, errors, new_errors, begin, end);
+    };
+
+    if (i < threads - 1) helpers.push_back(std::thread(work));
+    else work();
+  }
+  for (int i = 0; i < helpers.size(); i++) helpers[i].join();
 
+  double delta = 0;
+  for (int i = 0; i < threads; i++) delta += chunk_deltas[i];
+  return delta;
+}
+
+double tuning_thread::error_delta(packed_file& positions, std::vector<int>& support,
+                                  std::vector<double>& errors, std::vector<double>& new_errors,
+                                  int begin, int end) {
+  // (no pawn or material table here: the params change between calls)
+  double sum = 0;
+  double compensation = 0;
+  for (int i = begin; i < end; i++) {
+    int p = support[i];
+    unpack_position(positions[p], b);
+    int eval = evaluate(b) * (b.turn == WHITE ? 1 : -1);
+    double sigmoid = 1.0 / (1.0 + pow(10, -K * eval / 400.0));
+    double error = packed_result(positions[p]) - sigmoid;
+    new_errors[p] = error * error;
+
+    double y = (new_errors[p] - errors[p]) - compensation;
+    double t = sum + y;
+    compensation = (t - sum) - y;
+    sum = t;
+  }
+
+  return sum;
+}
+
+// calculate the MSE of the sigmoid of the current engine's evaluation and the game's final result.
+// every thread sums the errors of one contiguous chunk of the positions, and the
+// chunk sums are added up in order, so the result doesn't depend on timing:
+double MSE(std::vector<int>& params, packed_file& positions) {
   // load the params vector to the actual parameters:
   load_params(params);
 
-  // calculate MSE:
-  int eval;
-  double sigmoid;
-  double squared_error;
-  for (int p = 0; p < positions.size(); p++) {
-    // load the position to the global board object:
-    b = board(positions[p]->fen);
+  // split the positions into one chunk per thread (the last thread's chunk is
+  // evaluated on this thread):
+  std::vector<double> chunk_errors(num_threads);
+  std::vector<std::thread> helpers;
+  int chunk_size = (positions.size() + num_threads - 1) / num_threads;
+  for (int i = 0; i < num_threads; i++) {
+    int begin = std::min((int) positions.size(), i * chunk_size);
+    int end = std::min((int) positions.size(), begin + chunk_size);
+    tuning_thread* t = tuning_threads[i];
+    double* error = &chunk_errors[i];
+    auto work = [t, error, &positions, begin, end]() {
+      *error = t->squared_error(positions, begin, end);
+    };
+
+    if (i < num_threads - 1) helpers.push_back(std::thread(work));
+    else work();
+  }
+  for (int i = 0; i < helpers.size(); i++) helpers[i].join();
+
+  // calculate and return the MSE:
+  double total_squared_error = 0;
+  for (int i = 0; i < num_threads; i++) total_squared_error += chunk_errors[i];
+  return total_squared_error / positions.size();
+}
+
+double tuning_thread::squared_error(packed_file& positions, int begin, int end) {
+  // the cached pawn and material terms are stale, since the params changed:
+  pawns.clear();
+  materials.clear();
+
+  // the squared errors are summed with kahan summation, so that rounding errors
+  // don't drown out the tiny MSE differences the tuner compares:
+  double sum = 0;
+  double compensation = 0;
+  for (int p = begin; p < end; p++) {
+    // load the position to this thread's board:
+    unpack_position(positions[p], b);
 
     // statically evaluate the position using our current parameters:
-    eval = evaluate() * (b.turn == WHITE ? 1 : -1);
+    int eval = evaluate(b, &pawns, &materials) * (b.turn == WHITE ? 1 : -1);
 
     // calculate the sigmoid of this evaluation:
-    sigmoid = 1.0 / (1.0 + pow(10, -K * eval / 400.0));
+    double sigmoid = 1.0 / (1.0 + pow(10, -K * eval / 400.0));
+
+    // add the squared error to the sum:
+    double error = packed_result(positions[p]) - sigmoid;
+    double y = error * error - compensation;
+    double t = sum + y;
+    compensation = (t - sum) - y;
+    sum = t;
+  }
 
-    // calculate the squared error:
-    squared_error = pow(positions[p]->result - sigmoid, 2);
+  return sum;
+}
 
-    // add the squared error to the total squared error:
-    total_squared_error += squared_error;
+// param_index(): the index of the parameter at this location in params:
+int param_index(int* location) {
+  for (int i = 0; i < params.size(); i++) {
+    if (params[i] == location) return i;
   }
 
-  // calculate and return the MSE:
-  return total_squared_error / positions.size();
+  assert(false);
+  return -1;
 }
 
 void copy_params(std::vector<int>& destination) {
@@ -152,6 +515,9 @@ void load_params(std::vector<int>& source) {
       *dependencies[i].first = source[i] * dependencies[i].second;
     }
   }
+
+  // the PSTs are tuned through PIECE_SQUARE_TABLE, so repack them:
+  init_piece_square_scores();
 }
 
 void initialize_params_and_dependencies() {
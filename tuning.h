@@ -3,22 +3,75 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "eval.h"
 #include "eval_params.h"
 #include "globals.h"
+#include "packed.h"
 
-struct position_data {
-  char fen[128];
+// trace_coefficient: one nonzero term of a traced evaluation:
+struct trace_coefficient {
+  int param; // index into params
+  float coefficient; // d(eval)/d(param), including the PST tapering weights
+};
+
+// traced_position: a position's traced evaluation, which (relative to white) is
+// fixed_eval plus the sum of coefficients[begin, end) times their parameters:
+struct traced_position {
   double result;
+  double fixed_eval;
+  int begin;
+  int end;
+};
+
+/* tuning_thread: what each MSE() thread evaluates its share of the positions
+ * with. the board is reused for every position (so nothing is allocated per
+ * position), and the pawn and material tables are cleared at the start of
+ * every pass, since the parameters they cache changed.
+*/
+struct tuning_thread {
+  board b;
+  pawn_table pawns;
+  material_table materials;
+
+  tuning_thread() : b(FEN_START) {}
+
+  // gradient of this thread's squared errors in the last traced_squared_error():
+  std::vector<double> gradient;
+
+  // squared_error(): sum of the squared errors of positions [begin, end):
+  double squared_error(packed_file& positions, int begin, int end);
+
+  // error_delta(): re-evaluate positions support[begin, end) into new_errors,
+  // and return the sum of their changes from errors:
+  double error_delta(packed_file& positions, std::vector<int>& support,
+                     std::vector<double>& errors, std::vector<double>& new_errors,
+                     int begin, int end);
+
+  // traced_squared_error(): the same for traced positions [begin, end), with
+  // the given parameter values (and optionally the gradient):
+  double traced_squared_error(std::vector<traced_position>& traced,
+                              std::vector<trace_coefficient>& coefficients,
+                              std::vector<double>& values, int begin, int end,
+                              bool with_gradient);
 };
 
-// the constant value of K (for texel's sigmoid):
+// the constant value of K (for texel's sigmoid). the gradient tuner fits it:
 double K = 1.715;
 
+// gradient tuner settings (adam):
+#define ADAM_LEARNING_RATE 1.0
+#define ADAM_BETA1 0.9
+#define ADAM_BETA2 0.999
+#define GRADIENT_EPOCH_ITERATIONS 100 // iterations between snapshots
+#define GRADIENT_MAX_EPOCHS 100
+#define GRADIENT_MIN_IMPROVEMENT 1e-7 // stop when an epoch improves the MSE less than this
+
 // vector of all tuneable engine parameters, for cleaner code.
 // (we add more parameters to these later on!)
 std::vector<int*> params = {
@@ -38,12 +91,28 @@ std::vector<int*> params = {
 // dependencies[param] = {location of dependency, multiplier value (+/-1)}
 std::vector<std::pair<int*, int>> dependencies;
 
+// the MSE() threads (num_threads of them, set from the command line):
+std::vector<tuning_thread*> tuning_threads;
+
 // main functions:
 int main(int argc, char** argv);
-void tune(char* POSITIONS_FILE, int NUM_POSITIONS_TO_EXTRACT = 64000);
-double MSE(std::vector<int>& params, std::vector<position_data*>& positions);
+void tune(char* POSITIONS_FILE, int NUM_POSITIONS_TO_EXTRACT = 64000, bool gradient = true);
+void tune_local(packed_file& positions);
+void tune_gradient(packed_file& positions);
+double MSE(std::vector<int>& params, packed_file& positions);
+double support_error_delta(packed_file& positions, std::vector<int>& support,
+                           std::vector<double>& errors, std::vector<double>& new_errors);
+
+// gradient tuner functions:
+void trace_positions(packed_file& positions, std::vector<traced_position>& traced,
+                     std::vector<trace_coefficient>& coefficients, std::vector<bool>* is_traced = NULL);
+double find_K(std::vector<traced_position>& traced, std::vector<trace_coefficient>& coefficients,
+              std::vector<double>& values);
+double traced_MSE(std::vector<traced_position>& traced, std::vector<trace_coefficient>& coefficients,
+                  std::vector<double>& values, std::vector<double>* gradient);
 
 // utility functions:
+int param_index(int* location);
 void copy_params(std::vector<int>& destination);
 void load_params(std::vector<int>& source);
 void initialize_params_and_dependencies();
@@ -25,24 +25,45 @@ void uci_loop() {
     if (!strncmp(inbuf, "isready", 7)) printf("readyok\n");
     else if (!strncmp(inbuf, "position", 8)) parse_position(inbuf);
     else if (!strncmp(inbuf, "ucinewgame", 10)) {
-      // clear the transposition table and reset the board:
+      // clear the transposition and perft tables and reset the board:
       TT.clear();
+      perft_clear();
       parse_position("position startpos");
     }
     else if (!strncmp(inbuf, "go", 2)) parse_go(inbuf);
     else if (!strncmp(inbuf, "quit", 4)) break;
+    else if (!strncmp(inbuf, "bench", 5)) parse_bench(inbuf);
     else if (!strncmp(inbuf, "print", 5)) b.print();
     else if (!strncmp(inbuf, "setoption", 9)) parse_option(inbuf);
+    else if (!strncmp(inbuf, "stats", 5)) print_stats();
     else if (!strncmp(inbuf, "uci", 3)) {
       // print engine info:
       printf("id name %s\n", NAME);
       printf("id author %s\n", AUTHOR);
       printf("option name SyzygyPath type string default None\n");
+      printf("option name Hash type spin default %d min 1 max %d\n", DEFAULT_TT_SIZE, MAX_TT_SIZE);
+      printf("option name Clear Hash type button\n");
+      printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+#ifdef NNUE_EMBEDDED_FILE
+      printf("option name EvalFile type string default %s\n", NNUE_EMBEDDED_NAME);
+#else
+      printf("option name EvalFile type string default None\n");
+#endif
       printf("uciok\n");
     }
   }
 }
 
+// parse 'bench [depth] [threads] [hash] [json]' command (defaults: depth 10, 1
+// thread, DEFAULT_TT_SIZE MB, so that the node count is comparable between runs):
+void parse_bench(char* command) {
+  int depth = 10, threads = 1, hash_mb = DEFAULT_TT_SIZE;
+  sscanf(command + 5, "%d %d %d", &depth, &threads, &hash_mb);
+  bool json = strstr(command, "json");
+  bench(std::max(depth, 1), std::min(std::max(threads, 1), MAX_THREADS),
+        std::min(std::max(hash_mb, 1), MAX_TT_SIZE), json);
+}
+
 // parse 'position' command:
 void parse_position(char* command) {
   // move command pointer to the point immediately after 'position ':
@@ -111,7 +132,7 @@ void parse_go(char* command) {
   arg = strstr(command, "perft");
   if (arg) {
     depth = atoi(arg + 6);
-    printf("\nnodes searched: %llu\n", perft(depth, true));
+    printf("\nnodes searched: %llu\n", perft(b, depth, num_threads, true));
     return;
   }
 
@@ -177,7 +198,43 @@ void parse_option(char* command) {
 
   command += 5;
 
-  if (!strncmp(command, "SyzygyPath", 10)) {
+  if (!strncmp(command, "Hash", 4)) {
+    // expect next characters to be 'Hash value '
+    command += 11;
+    TT.resize(std::min(std::max(atoi(command), 1), MAX_TT_SIZE));
+  }
+
+  else if (!strncmp(command, "Clear Hash", 10)) TT.clear();
+
+  else if (!strncmp(command, "Threads", 7)) {
+    // expect next characters to be 'Threads value '
+    command += 14;
+    num_threads = std::min(std::max(atoi(command), 1), MAX_THREADS);
+  }
+
+  else if (!strncmp(command, "EvalFile", 8)) {
+    // expect next characters to be 'EvalFile value '
+    command += 15;
+
+    // remove the newline and trailing whitespace:
+    char* end = command + strlen(command) - 1;
+    while (end >= command && isspace((unsigned char) *end)) end--;
+    end[1] = 0;
+
+    // 'None' (or nothing) switches back to the hand-crafted evaluation:
+    if (!*command || !strcmp(command, "None")) {
+      nnue_unload();
+      printf("info string using the hand-crafted evaluation\n");
+    }
+    else if (nnue_load_file(command)) printf("info string loaded network %s\n", command);
+    else printf("info string error: could not load network %s\n", command);
+
+    // cached evaluations belong to the old evaluation function:
+    TT.clear();
+    for (int i = 0; i < search_threads.size(); i++) search_threads[i]->evals.clear();
+  }
+
+  else if (!strncmp(command, "SyzygyPath", 10)) {
     // expect next characters to be 'SyzygyPath value '
     command += 17;
 
@@ -15,6 +15,9 @@
 // start UCI communication:
 void uci_loop();
 
+// parse 'bench' command (also run by 'main.out bench ...'):
+void parse_bench(char* command);
+
 // parse 'position' command:
 void parse_position(char* command);
 
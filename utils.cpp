@@ -68,25 +68,88 @@ void read_input() {
 // make sure we didn't get any stop or quit command, and that we still have time:
 void communicate() {
   if (time_set && (get_time() > stop_time)) stop_search = true;
-  read_input();
+  if (read_gui_input) read_input();
 }
 
-long perft(int depth, bool root) {
+// perft_key(): the board's hash, plus the en passant file if the last move was
+// a double pawn push (which the hash doesn't include, but perft counts depend on):
+static U64 perft_key(board& b) {
+  if (!b.ply || !MOVE_IS_PAWNFIRST(b.history[b.ply-1].move)) return b.hash;
+  return b.hash ^ ZOBRIST_EP_KEYS[FILE_NO(MOVE_TO(b.history[b.ply-1].move))];
+}
+
+// perft_search(): the leaf count of one subtree (counted in bulk at depth 1):
+static U64 perft_search(board& b, int depth, perft_entry* table) {
+  if (depth == 0) return 1;
+
   int moves[MAX_POSITION_MOVES];
-  int num_moves = b.get_moves(moves);
-  if (depth == 1) return num_moves;
+  if (depth == 1) return b.get_moves(moves);
 
-  long sum = 0;
+  U64 key = perft_key(b);
+  perft_entry* entry = &table[key & (PERFT_TABLE_SIZE - 1)];
+  U64 data = entry->data.load(std::memory_order_relaxed);
+  if ((entry->key.load(std::memory_order_relaxed) ^ data) == key && (data & 0xFF) == depth) {
+    return data >> 8;
+  }
+
+  int num_moves = b.get_moves(moves);
+  U64 sum = 0;
   for (int i = 0; i < num_moves; i++) {
     b.make_move(moves[i]);
-    if (root) {
-      long branch = perft(depth - 1, false);
+    sum += perft_search(b, depth - 1, table);
+    b.undo_move();
+  }
+
+  data = (sum << 8) | depth;
+  entry->key.store(key ^ data, std::memory_order_relaxed);
+  entry->data.store(data, std::memory_order_relaxed);
+  return sum;
+}
+
+// the perft hash table, allocated by the first perft() and kept for the next
+// ones (its entries stay valid, since they're keyed by position and depth):
+static std::vector<perft_entry> perft_table;
+
+void perft_clear() {
+  for (int i = 0; i < perft_table.size(); i++) {
+    perft_table[i].key.store(0, std::memory_order_relaxed);
+    perft_table[i].data.store(0, std::memory_order_relaxed);
+  }
+}
+
+U64 perft(board& b, int depth, int threads, bool divide) {
+  if (depth <= 0) return 1;
+  if (perft_table.empty()) perft_table = std::vector<perft_entry>(PERFT_TABLE_SIZE);
+
+  int moves[MAX_POSITION_MOVES];
+  int num_moves = b.get_moves(moves);
+
+  // the threads take root moves until there are none left:
+  std::vector<U64> counts(num_moves);
+  std::atomic<int> next_move(0);
+  auto work = [&]() {
+    board local = b;
+    int i;
+    while ((i = next_move++) < num_moves) {
+      local.make_move(moves[i]);
+      counts[i] = perft_search(local, depth - 1, perft_table.data());
+      local.undo_move();
+    }
+  };
+
+  threads = std::max(1, std::min(threads, num_moves));
+  std::vector<std::thread> helpers;
+  for (int i = 1; i < threads; i++) helpers.push_back(std::thread(work));
+  work();
+  for (int i = 0; i < helpers.size(); i++) helpers[i].join();
+
+  U64 sum = 0;
+  for (int i = 0; i < num_moves; i++) {
+    if (divide) {
       print_move(moves[i]);
-      printf(": %llu\n", branch);
-      sum += branch;
+      printf(": %llu\n", counts[i]);
     }
-    else sum += perft(depth - 1, false);
-    b.undo_move();
+    sum += counts[i];
   }
 
   return sum;
@@ -1,8 +1,11 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <atomic>
 #include <chrono>
 #include <stdio.h>
+#include <thread>
+#include <vector>
 
 #if defined(_WIN32) || defined(_WIN64)
   #include <io.h>
@@ -39,7 +42,24 @@ void read_input();
 // make sure we didn't get any stop or quit command, and that we still have time:
 void communicate();
 
-// perft function for 'go perft' command:
-long perft(int depth, bool root);
+/* perft_entry: a perft hash table entry, holding the leaf count of a subtree.
+ * perft threads share the table without locks, so like in the TT, the key is
+ * XORed with the data word (count << 8 | depth): an entry torn by two racing
+ * writes fails the key check.
+*/
+struct perft_entry {
+  std::atomic<U64> key;
+  std::atomic<U64> data;
+};
+
+#define PERFT_TABLE_SIZE (1 << 20) // entries (16 MB), must be a power of 2
+
+// perft function for 'go perft' command (and the tests). the root moves are
+// split across the threads, which share a perft hash table (kept between
+// calls), and with divide, every root move's count is printed:
+U64 perft(board& b, int depth, int threads, bool divide);
+
+// perft_clear(): empty the perft hash table:
+void perft_clear();
 
 #endif